@@ -1,6 +1,7 @@
 /* 
  * clock.c - Routines for using the cycle counters on x86, 
  *           Alpha, and Sparc boxes.
+ * AN: and x86-64, where the counter is the time stamp counter (TSC)
  * 
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
@@ -9,6 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/times.h>
 #include "clock.h"
 
@@ -71,6 +73,99 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+/* AN: the counter is always there on x86; 32-bit builds do not ask 
+ * CPUID whether it is invariant */
+int counter_available(void)
+{
+    return 1;
+}
+
+int counter_invariant(void)
+{
+    return 0;
+}
+
+#elif defined(__x86_64__)
+/*******************************************************
+ * AN: x86-64 versions of start_counter() and get_counter()
+ *
+ * The TSC is read with rdtsc behind an lfence at the start, so the 
+ * instructions before it are done, and with rdtscp (or lfence; rdtsc 
+ * where there is no rdtscp) followed by an lfence at the end, so the
+ * code being timed is done and the code after it has not started.
+ * Only an invariant TSC (CPUID 0x80000007, EDX bit 8) ticks at a 
+ * constant rate through frequency and power state changes; otherwise
+ * the cycle counts do not track time.
+ *******************************************************/
+#include <cpuid.h>
+
+static unsigned long long cyc_start = 0;
+static int has_rdtscp = -1;     /* -1 until CPUID has been asked */
+static int is_invariant = 0;
+
+static void probe_tsc(void)
+{
+    unsigned a, b, c, d;
+
+    has_rdtscp = __get_cpuid(0x80000001, &a, &b, &c, &d) && (d & (1 << 27));
+    is_invariant = __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1 << 8));
+}
+
+static inline unsigned long long tsc_start(void)
+{
+    unsigned hi, lo;
+
+    asm volatile("lfence; rdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+static inline unsigned long long tsc_end(void)
+{
+    unsigned hi, lo, aux;
+
+    if (has_rdtscp)
+	asm volatile("rdtscp; lfence" : "=a" (lo), "=d" (hi), "=c" (aux) 
+		     : : "memory");
+    else
+	asm volatile("lfence; rdtsc; lfence" : "=a" (lo), "=d" (hi) 
+		     : : "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    if (has_rdtscp < 0)
+	probe_tsc();
+    cyc_start = tsc_start();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    return (double)(tsc_end() - cyc_start);
+}
+
+int counter_available(void)
+{
+    return 1;
+}
+
+int counter_invariant(void)
+{
+    if (has_rdtscp < 0)
+	probe_tsc();
+    return is_invariant;
+}
+
+/* AN: the TSC, ordered against the code on both sides */
+unsigned long long read_counter(void)
+{
+    if (has_rdtscp < 0)
+	probe_tsc();
+    return tsc_end();
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -133,6 +228,16 @@ double get_counter()
     return result;
 }
 
+int counter_available(void)
+{
+    return 1;
+}
+
+int counter_invariant(void)
+{
+    return 0;
+}
+
 #else
 
 /****************************************************************
@@ -158,6 +263,28 @@ double get_counter()
     printf("Please choose another timing package in config.h.\n");
     exit(1);
 }
+
+/* AN: so the driver can pick another timer instead */
+int counter_available(void)
+{
+    return 0;
+}
+
+int counter_invariant(void)
+{
+    return 0;
+}
+#endif
+
+#if !defined(__x86_64__)
+/* AN: elsewhere read_counter counts nanoseconds of the monotonic clock */
+unsigned long long read_counter(void)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long long)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
 #endif
 
 
@@ -179,16 +306,30 @@ double ovhd()
     return result;
 }
 
+/* AN: the clock the counter is calibrated against, not slewed by NTP */
+#ifdef CLOCK_MONOTONIC_RAW
+#define CALIBRATION_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define CALIBRATION_CLOCK CLOCK_MONOTONIC
+#endif
+
 /* $begin mhz */
 /* Estimate the clock rate by measuring the cycles that elapse */ 
 /* while sleeping for sleeptime seconds */
+/* AN: against the time CALIBRATION_CLOCK saw pass, rather than the 
+ * sleeptime asked for, which a sleep always overruns */
 double mhz_full(int verbose, int sleeptime)
 {
-    double rate;
+    double rate, secs;
+    struct timespec t0, t1;
 
+    clock_gettime(CALIBRATION_CLOCK, &t0);
     start_counter();
     sleep(sleeptime);
-    rate = get_counter() / (1e6*sleeptime);
+    rate = get_counter();
+    clock_gettime(CALIBRATION_CLOCK, &t1);
+    secs = (t1.tv_sec - t0.tv_sec) + 1e-9*(t1.tv_nsec - t0.tv_nsec);
+    rate /= 1e6*secs;
     if (verbose) 
 	printf("Processor clock rate ~= %.1f MHz\n", rate);
     return rate;
@@ -201,6 +342,25 @@ double mhz(int verbose)
     return mhz_full(verbose, 2);
 }
 
+/* AN: ticks of read_counter per microsecond, measured once over 50 ms */
+double counter_mhz(void)
+{
+    static double rate = 0;
+    struct timespec t0, t1, nap = {0, 50000000};
+    unsigned long long c0, c1;
+
+    if (rate == 0) {
+	clock_gettime(CALIBRATION_CLOCK, &t0);
+	c0 = read_counter();
+	nanosleep(&nap, NULL);
+	c1 = read_counter();
+	clock_gettime(CALIBRATION_CLOCK, &t1);
+	rate = (c1 - c0) / 
+	    (1e6*((t1.tv_sec - t0.tv_sec) + 1e-9*(t1.tv_nsec - t0.tv_nsec)));
+    }
+    return rate;
+}
+
 /** Special counters that compensate for timer interrupt overhead */
 
 static double cyc_per_tick = 0.0;
@@ -9,6 +9,17 @@ double get_counter();
 /* Measure overhead for counter */
 double ovhd();
 
+/* AN: Is there a cycle counter on this platform, and does it tick at
+   a constant rate (an invariant TSC)? */
+int counter_available(void);
+int counter_invariant(void);
+
+/* AN: A raw read of the cycle counter, cheap enough to time a single 
+   call (nanoseconds where there is no counter), and its ticks per 
+   microsecond */
+unsigned long long read_counter(void);
+double counter_mhz(void);
+
 /* Determine clock rate of processor (using a default sleeptime) */
 double mhz(int verbose);
 
@@ -57,19 +57,27 @@
 
 /* 
  * Alignment requirement in bytes (either 4 or 8) 
+ * AN: 16 on 64-bit builds, like the malloc of the platform
  */
+#if defined(__LP64__) || defined(_LP64)
+#define ALIGNMENT 16
+#else
 #define ALIGNMENT 8  
+#endif
 
 /* 
  * Maximum heap size in bytes 
+ * AN: only the default now; mdriver -m reserves a different size
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
+ * AN: this is only the default now; mdriver -T picks one at runtime
  *****************************************************************************/
-#define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
+#define USE_FCYC   0   /* cycle counter w/K-best scheme (x86, x86-64 & Alpha) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_CLOCK  1   /* AN: clock_gettime, in ns (any POSIX box) */
 
 #endif /* __CONFIG_H */
@@ -2,6 +2,9 @@
  * High-level timing wrappers
  ****************************/
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "fsecs.h"
 #include "fcyc.h"
 #include "clock.h"
@@ -10,6 +13,28 @@
 
 static double Mhz;  /* estimated CPU clock frequency */
 
+/* AN: the timing method, from config.h until set_fsecs_timer */
+#if USE_FCYC
+static int timer = FSECS_FCYC;
+#elif USE_ITIMER
+static int timer = FSECS_ITIMER;
+#elif USE_GETTOD
+static int timer = FSECS_GETTOD;
+#else
+static int timer = FSECS_CLOCK;
+#endif
+
+static char *timer_names[] = {"fcyc", "itimer", "gettod", "clock"};
+
+/* AN: the sampling scheme (set_fsecs_samples), and the last samples */
+#define FSECS_RESAMPLES 1000  /* bootstrap resamples of the median */
+static int warmups = 0;
+static int nsamples = 0;
+static fsecs_dist_t last;
+
+static double time_f(fsecs_test_funct f, void *argp, int runs);
+static void summarize(fsecs_dist_t *d);
+
 extern int verbose; /* -v option in mdriver.c */
 
 /*
@@ -19,39 +44,178 @@ void init_fsecs(void)
 {
     Mhz = 0; /* keep gcc -Wall happy */
 
-#if USE_FCYC
-    if (verbose)
-	printf("Measuring performance with a cycle counter.\n");
-
-    /* set key parameters for the fcyc package */
-    set_fcyc_maxsamples(20); 
-    set_fcyc_clear_cache(1);
-    set_fcyc_compensate(1);
-    set_fcyc_epsilon(0.01);
-    set_fcyc_k(3);
-    Mhz = mhz(verbose > 0);
-#elif USE_ITIMER
-    if (verbose)
-	printf("Measuring performance with the interval timer.\n");
-#elif USE_GETTOD
-    if (verbose)
-	printf("Measuring performance with gettimeofday().\n");
-#endif
+    switch (timer) {
+    case FSECS_FCYC:
+	if (verbose)
+	    printf("Measuring performance with a cycle counter.\n");
+	if (!counter_invariant())
+	    printf("Warning: the cycle counter is not known to tick at a "
+		   "constant rate.\n");
+
+	/* set key parameters for the fcyc package */
+	set_fcyc_maxsamples(20); 
+	set_fcyc_clear_cache(1);
+	set_fcyc_compensate(1);
+	set_fcyc_epsilon(0.01);
+	set_fcyc_k(3);
+	Mhz = mhz(verbose > 0);
+	break;
+    case FSECS_ITIMER:
+	if (verbose)
+	    printf("Measuring performance with the interval timer.\n");
+	break;
+    case FSECS_GETTOD:
+	if (verbose)
+	    printf("Measuring performance with gettimeofday().\n");
+	break;
+    case FSECS_CLOCK:
+	if (verbose)
+	    printf("Measuring performance with clock_gettime().\n");
+	break;
+    }
+}
+
+/*
+ * set_fsecs_timer - AN: select the timing method by name
+ */
+int set_fsecs_timer(char *name)
+{
+    int t;
+
+    for (t = FSECS_FCYC; t <= FSECS_CLOCK; t++)
+	if (!strcmp(name, timer_names[t]))
+	    break;
+    if ((t > FSECS_CLOCK) || ((t == FSECS_FCYC) && !counter_available()))
+	return -1;
+    timer = t;
+    return 0;
+}
+
+/*
+ * fsecs_timer_name - AN: the name of the timing method in use
+ */
+char *fsecs_timer_name(void)
+{
+    return timer_names[timer];
 }
 
 /*
  * fsecs - Return the running time of a function f (in seconds)
+ * AN: or, with samples, the median of that many timed runs after the
+ *     warmup runs
  */
 double fsecs(fsecs_test_funct f, void *argp) 
 {
-#if USE_FCYC
-    double cycles = fcyc(f, argp);
-    return cycles/(Mhz*1e6);
-#elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
-#elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
-#endif 
+    int i;
+
+    for (i = 0; i < warmups; i++)
+	f(argp);
+
+    if (nsamples == 0) {
+	last.n = 1;
+	last.samples[0] = time_f(f, argp, 10);
+	summarize(&last);
+	return last.samples[0];
+    }
+
+    for (i = 0; i < nsamples; i++)
+	last.samples[i] = time_f(f, argp, 1);
+    last.n = nsamples;
+    summarize(&last);
+    return last.median;
+}
+
+/*
+ * time_f - AN: one measurement of f with the selected timer; was fsecs.
+ *     The timers average over runs runs of f, fcyc takes the K best of
+ *     as many as it needs; with runs = 1, a sample, each of them times
+ *     exactly one run.
+ */
+static double time_f(fsecs_test_funct f, void *argp, int runs) 
+{
+    switch (timer) {
+    case FSECS_FCYC:
+	if (runs == 1) {
+	    start_counter();
+	    f(argp);
+	    return get_counter()/(Mhz*1e6);
+	}
+	return fcyc(f, argp)/(Mhz*1e6);
+    case FSECS_ITIMER:
+	return ftimer_itimer(f, argp, runs);
+    case FSECS_GETTOD:
+	return ftimer_gettod(f, argp, runs);
+    default:
+	return ftimer_clock(f, argp, runs);
+    }
+}
+
+/*
+ * set_fsecs_samples - AN: warmup runs, and timed runs, of each fsecs call
+ */
+void set_fsecs_samples(int warmup, int samples)
+{
+    warmups = (warmup > 0) ? warmup : 0;
+    nsamples = (samples > FSECS_MAXSAMPLES) ? FSECS_MAXSAMPLES : 
+	((samples > 0) ? samples : 0);
+}
+
+/*
+ * fsecs_dist - AN: copy out the samples of the last fsecs call
+ */
+void fsecs_dist(fsecs_dist_t *dist)
+{
+    *dist = last;
+}
+
+/*
+ * AN: The statistics of a set of samples. The confidence interval of 
+ * the median is a percentile bootstrap: the median of FSECS_RESAMPLES
+ * resamples (n draws with replacement), of which the middle 95% is 
+ * kept. The draws use a fixed seed, so a set of samples always gives 
+ * the same interval.
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x < y) ? -1 : (x > y);
 }
 
+static double median_of(double *v, int n)
+{
+    qsort(v, n, sizeof(double), cmp_double);
+    return (n % 2) ? v[n/2] : (v[n/2 - 1] + v[n/2]) / 2;
+}
+
+static void summarize(fsecs_dist_t *d)
+{
+    double v[FSECS_MAXSAMPLES];
+    static double medians[FSECS_RESAMPLES];
+    double sum = 0, sq = 0;
+    unsigned long long x = 0x9e3779b97f4a7c15ULL;  /* xorshift64 state */
+    int i, j;
 
+    for (i = 0; i < d->n; i++)
+	sum += d->samples[i];
+    d->mean = sum / d->n;
+    for (i = 0; i < d->n; i++)
+	sq += (d->samples[i] - d->mean) * (d->samples[i] - d->mean);
+    d->stddev = (d->n > 1) ? sqrt(sq / (d->n - 1)) : 0;
+
+    memcpy(v, d->samples, d->n * sizeof(double));
+    d->median = median_of(v, d->n);
+    d->min = v[0];
+
+    for (j = 0; j < FSECS_RESAMPLES; j++) {
+	for (i = 0; i < d->n; i++) {
+	    x ^= x << 13;
+	    x ^= x >> 7;
+	    x ^= x << 17;
+	    v[i] = d->samples[x % d->n];
+	}
+	medians[j] = median_of(v, d->n);
+    }
+    qsort(medians, FSECS_RESAMPLES, sizeof(double), cmp_double);
+    d->ci_lo = medians[(int)(0.025 * FSECS_RESAMPLES)];
+    d->ci_hi = medians[(int)(0.975 * FSECS_RESAMPLES) - 1];
+}
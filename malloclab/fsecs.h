@@ -2,3 +2,45 @@ typedef void (*fsecs_test_funct)(void *);
 
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+
+/* AN: the timing methods; the USE_xxx switch in config.h is the default */
+#define FSECS_FCYC   0  /* cycle counter w/K-best scheme */
+#define FSECS_ITIMER 1  /* interval timer */
+#define FSECS_GETTOD 2  /* gettimeofday */
+#define FSECS_CLOCK  3  /* clock_gettime */
+
+/* 
+ * AN: set_fsecs_timer - Select the timing method, by name (fcyc, itimer,
+ *     gettod or clock), before init_fsecs. Returns -1 if there is no 
+ *     such method on this platform.
+ */
+int set_fsecs_timer(char *name);
+
+/* AN: fsecs_timer_name - The name of the timing method in use */
+char *fsecs_timer_name(void);
+
+/* AN: most samples fsecs takes of one function */
+#define FSECS_MAXSAMPLES 100
+
+/* AN: distribution of the samples of one fsecs call, in seconds */
+typedef struct {
+    int n;                      /* samples taken */
+    double samples[FSECS_MAXSAMPLES]; /* each of them, in order */
+    double min;
+    double median;
+    double mean;
+    double stddev;
+    double ci_lo;               /* 95% bootstrap confidence interval ... */
+    double ci_hi;               /* ... of the median */
+} fsecs_dist_t;
+
+/* 
+ * AN: set_fsecs_samples - Run f warmup times untimed, then time each of 
+ *     samples runs on its own; fsecs returns their median. Default = 0 
+ *     samples, the plain measurement of the selected timer (still after
+ *     the warmup runs).
+ */
+void set_fsecs_samples(int warmup, int samples);
+
+/* AN: fsecs_dist - The samples of the last fsecs call */
+void fsecs_dist(fsecs_dist_t *dist);
@@ -7,8 +7,10 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_clock: AN: version that uses clock_gettime
  */
 #include <stdio.h>
+#include <time.h>
 #include <sys/time.h>
 #include "ftimer.h"
 
@@ -53,6 +55,31 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
 }
 
 
+/* 
+ * ftimer_clock - AN: Use clock_gettime to estimate the running time of
+ * f(argp), in nanoseconds on the raw monotonic clock where there is 
+ * one. Return the average of n runs.  
+ */
+double ftimer_clock(ftimer_test_funct f, void *argp, int n)
+{
+    int i;
+    struct timespec st, et;
+
+#ifdef CLOCK_MONOTONIC_RAW
+    clock_gettime(CLOCK_MONOTONIC_RAW, &st);
+    for (i = 0; i < n; i++) 
+	f(argp);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &et);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &st);
+    for (i = 0; i < n; i++) 
+	f(argp);
+    clock_gettime(CLOCK_MONOTONIC, &et);
+#endif
+    return ((et.tv_sec - st.tv_sec) + 1E-9*(et.tv_nsec - st.tv_nsec)) / n;
+}
+
+
 /*
  * Routines for manipulating the Unix interval timer
  */
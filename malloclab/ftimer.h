@@ -12,3 +12,6 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/* AN: Estimate the running time of f(argp) using clock_gettime
+   Return the average of n runs */
+double ftimer_clock(ftimer_test_funct f, void *argp, int n);
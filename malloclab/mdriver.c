@@ -7,6 +7,7 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE /* AN: sched_setaffinity, pthread_attr_setaffinity_np */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -15,52 +16,60 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sched.h>
+#include <pthread.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
+#include "perfctr.h"
 #include "config.h"
+#include "mdriver.h"
+#include "trace.h"
+#include "stats.h"
+#include "workers.h"
 
 /**********************
  * Constants and macros
  **********************/
 
 /* Misc */
-#define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define RSS_INTERVAL  64 /* AN: ops between samples of the resident set */
+#define RANGE_SLAB  1024 /* AN: range records per slab */
+#define HIST_BITS      5 /* AN: 2^HIST_BITS buckets per power of two */
+#define HIST_SUB (1 << HIST_BITS)
+#define HIST_BUCKETS ((64 - HIST_BITS + 1) * HIST_SUB)
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+/* AN: through uintptr_t, so 64-bit pointers are not truncated */
+#define IS_ALIGNED(p)  ((((uintptr_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
  *****************************/
 
 /* Records the extent of each block's payload */
+/* AN: as a node of an AVL tree ordered by lo */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* lower payloads (next free record if unused) */
+    struct range_t *right; /* higher payloads */
+    int height;            /* height of the subtree */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
-typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc/realloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc/realloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
+/* AN: range records are carved from slabs of RANGE_SLAB */
+typedef struct range_slab_t {
+    struct range_slab_t *next;
+    range_t ranges[RANGE_SLAB];
+} range_slab_t;
 
 /* 
  * Holds the params to the xxx_speed functions, which are timed by fcyc. 
@@ -72,25 +81,43 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
-/* Summarizes the important stats for some malloc function on some trace */
+/* AN: log-bucketed (HDR style) histograms of request latencies in 
+ * counter ticks, per request type and size class, for eval_mm_latency */
 typedef struct {
-    /* defined for both libc malloc and student malloc package (mm.c) */
-    double ops;      /* number of ops (malloc/free/realloc) in the trace */
-    int valid;       /* was the trace processed correctly by the allocator? */
-    double secs;     /* number of secs needed to run the trace */
+    trace_t *trace;
+    unsigned long long overhead;  /* ticks of a back to back read */
+    unsigned long long max[LAT_TYPES][LAT_CLASSES];
+    long hist[LAT_TYPES][LAT_CLASSES][HIST_BUCKETS];
+    slowop_t worst[LAT_WORST];    /* in ticks until latency_summary */
+} latency_run_t;
 
-    /* defined only for the student malloc package */
-    double util;     /* space utilization for this trace (always 0 for libc) */
+/* AN: a thread of a threaded replay, and the requests it makes */
+typedef struct {
+    struct replay_t *replay;
+    long *reqs;          /* requests of the thread, in trace order */
+    long nreqs;          /* and how many */
+} replay_thread_t;
 
-    /* Note: secs and util are only defined if valid is true */
-} stats_t; 
+/* AN: a replay of a thread-tagged trace on nthreads threads */
+typedef struct replay_t {
+    trace_t *trace;
+    int nthreads;
+    int *seqs;           /* place of each request among those on its id */
+    int *gens;           /* requests made so far on each id */
+    pthread_attr_t attrs[MAXTHREADS];    /* each pinned to a CPU */
+    replay_thread_t threads[MAXTHREADS];
+} replay_t;
 
 /********************
  * Global variables
  *******************/
 int verbose = 0;        /* global flag for verbose output */
-static int errors = 0;  /* number of errs found when running student malloc */
-char msg[MAXLINE];      /* for whenever we need to compose an error message */
+int errors = 0;         /* number of errs found when running student malloc */
+char msg[2*MAXLINE];    /* for whenever we need to compose an error message */
+
+/* AN: slabs of range records, and the records not in use */
+static range_slab_t *range_slabs = NULL;
+static range_t *range_free = NULL;
 
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
@@ -100,21 +127,29 @@ static char *default_tracefiles[] = {
     DEFAULT_TRACEFILES, NULL
 };
 
+/* AN: count hardware events on a run of each trace (set by -e) */
+static int count_events = 0;
+
+/* AN: time each request of a run of each trace (set by -L) */
+int time_requests = 0;
+
+/* AN: block extents of the trace being evaluated */
+static range_t *trace_ranges = NULL;
+
+/* AN: heap on huge pages that each trace is also timed on (-H), or NULL */
+static mem_arena_t *huge_arena = NULL;
+
 
 /********************* 
  * Function prototypes 
  *********************/
 
 /* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
-		     int tracenum, int opnum);
+static int add_range(range_t **ranges, char *lo, size_t size, 
+		     int tracenum, long opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
 
-/* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
-
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
 static void eval_libc_speed(void *ptr);
@@ -122,15 +157,35 @@ static void eval_libc_speed(void *ptr);
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   double *rss);
 static void eval_mm_speed(void *ptr);
 
+/* AN: Timing each request */
+static void eval_mm_latency(trace_t *trace, stats_t *stats);
+static void eval_mm_latency_run(void *ptr);
+static void latency_record(latency_run_t *lr, long i, int type, size_t size,
+			   unsigned long long ticks);
+static void latency_summary(latency_t *l, long *hist, 
+			    unsigned long long max, double mhz);
+static int hist_bucket(unsigned long long v);
+static unsigned long long hist_value(int b);
+static double hist_percentile(long *hist, long count, double q);
+
+/* AN: Replaying thread-tagged traces on threads */
+static void eval_mm_threads(trace_t *trace, stats_t *stats);
+static void eval_mm_replay(void *ptr);
+static void *replay_thread(void *ptr);
+
+/* AN: Evaluating whole traces (in worker processes: workers.c) */
+static void eval_libc_trace(char *filename, int tracenum, stats_t *stats);
+static void eval_mm_trace(char *filename, int tracenum, stats_t *stats);
+
 /* Various helper routines */
-static void printresults(int n, stats_t *stats);
+static void sbrk_summary(stats_t *stats);
 static void usage(void);
-static void unix_error(char *msg);
-static void malloc_error(int tracenum, int opnum, char *msg);
-static void app_error(char *msg);
+static size_t parse_size(char *arg);
+static void malloc_error(int tracenum, long opnum, char *msg);
 
 /**************
  * Main routine
@@ -141,15 +196,18 @@ int main(int argc, char **argv)
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
-    trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
-    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    size_t max_heap = MAX_HEAP; /* AN: heap reservation (set by -m) */
+    int huge_pages = MEM_PAGES_NORMAL; /* AN: also time on huge pages (-H) */
+    int warmup = 0;      /* AN: untimed runs before the samples (-w) */
+    int samples = 0;     /* AN: timed runs per trace, 0 for fsecs' own (-n) */
+    int pin_cpu = -1;    /* AN: CPU to run on (-c) */
+    char *outfile = NULL;/* AN: JSON or CSV file for the results (-o) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +216,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:m:H:j:w:n:c:o:T:hvVgalFCSPeL")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,6 +242,63 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+	case 'm': /* AN: Bytes of address space to reserve for the heap */
+	    max_heap = parse_size(optarg);
+	    mem_set_max_heap(max_heap);
+	    break;
+	case 'H': /* AN: Time each trace on a huge page heap as well */
+	    if (!strcmp(optarg, "thp"))
+		huge_pages = MEM_PAGES_THP;
+	    else if (!strcmp(optarg, "tlb"))
+		huge_pages = MEM_PAGES_HUGETLB;
+	    else {
+		usage();
+		exit(1);
+	    }
+	    break;
+        case 'C': /* AN: Don't use or write .repb trace caches */
+            use_cache = 0;
+            break;
+        case 'S': /* AN: Stream traces rather than load them */
+            stream_traces = 1;
+            break;
+        case 'j': /* AN: Evaluate traces in this many worker processes */
+	    jobs = atoi(optarg);  /* capped at the CPUs we may run on */
+	    break;
+        case 'P': /* AN: Let the workers time their traces in parallel */
+            time_parallel = 1;
+            break;
+	case 'w': /* AN: Untimed runs of each trace before the samples */
+	    warmup = atoi(optarg);
+	    break;
+	case 'n': /* AN: Time this many runs of each trace one by one */
+	    samples = atoi(optarg);
+	    if ((samples < 0) || (samples > FSECS_MAXSAMPLES)) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'c': /* AN: Pin the driver to this CPU */
+	    pin_cpu = atoi(optarg);
+	    break;
+	case 'o': /* AN: Also write the results to this .json or .csv file */
+	    outfile = optarg;
+	    break;
+	case 'e': /* AN: Count hardware events on a run of each trace */
+	    count_events = 1;
+	    break;
+	case 'L': /* AN: Time each request of a run of each trace */
+	    time_requests = 1;
+	    break;
+	case 'T': /* AN: Timing method: fcyc, itimer, gettod or clock */
+	    if (set_fsecs_timer(optarg) < 0) {
+		usage();
+		exit(1);
+	    }
+	    break;
+        case 'F': /* AN: Use deferred coalescing (fast bins) in mm.c */
+            mm_set_fastbins(1);
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -237,6 +352,13 @@ int main(int argc, char **argv)
 
     /* Initialize the timing package */
     init_fsecs();
+    set_fsecs_samples(warmup, samples);
+
+    /* AN: and find the CPUs to pin workers and threads to */
+    init_workers(pin_cpu);
+
+    /* AN: and the latency classes, which follow the paths of mm.c */
+    init_lat_classes();
 
     /*
      * Optionally run and evaluate the libc malloc package 
@@ -251,20 +373,7 @@ int main(int argc, char **argv)
 	    unix_error("libc_stats calloc in main failed");
 	
 	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-	    }
-	    free_trace(trace);
-	}
+	eval_traces(tracefiles, num_tracefiles, libc_stats, eval_libc_trace);
 
 	/* Display the libc results in a compact table */
 	if (verbose) {
@@ -287,26 +396,16 @@ int main(int argc, char **argv)
     /* Initialize the simulated memory system in memlib.c */
     mem_init(); 
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
+    /* AN: and a second heap on huge pages, to compare against */
+    if (huge_pages != MEM_PAGES_NORMAL) {
+	if ((huge_arena = mem_arena_create_pages(max_heap, huge_pages)) == NULL)
+	    unix_error("mem_arena_create_pages in main failed");
+	huge_pages = mem_arena_pages(huge_arena);
     }
 
+    /* Evaluate student's mm malloc package using the K-best scheme */
+    eval_traces(tracefiles, num_tracefiles, mm_stats, eval_mm_trace);
+
     /* Display the mm results in a compact table */
     if (verbose) {
 	printf("\nResults for mm malloc:\n");
@@ -314,6 +413,53 @@ int main(int argc, char **argv)
 	printf("\n");
     }
 
+    /* AN: and how the heap grew on each trace */
+    if (verbose > 1) {
+	printf("Heap growth for mm malloc:\n");
+	printsbrk(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* AN: and what huge pages did to the throughput */
+    if (huge_arena != NULL) {
+	printf("Huge pages for mm malloc:\n");
+	printhuge(num_tracefiles, mm_stats, huge_pages);
+	printf("\n");
+	mem_arena_destroy(huge_arena);
+    }
+
+    /* AN: and how the timed runs of each trace were spread */
+    if (samples > 0) {
+	printf("Timing distribution for mm malloc (%d runs after %d warmup):\n",
+	       samples, warmup);
+	printtiming(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* AN: and what the hardware counted */
+    if (count_events) {
+	printf("Hardware events for mm malloc, per op:\n");
+	printevents(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* AN: and how long single requests took */
+    if (time_requests) {
+	printf("Request latency for mm malloc, in ns:\n");
+	printlatency(num_tracefiles, tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /* AN: and how the thread-tagged traces scale on threads */
+    for (i=0; i < num_tracefiles; i++)
+	if (mm_stats[i].valid && (mm_stats[i].threads > 0))
+	    break;
+    if (i < num_tracefiles) {
+	printf("Thread scaling for mm malloc:\n");
+	printthreads(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
      */
@@ -357,6 +503,12 @@ int main(int argc, char **argv)
 	printf("Terminated with %d errors\n", errors);
     }
 
+    /* AN: and in a file, for scripts */
+    if (outfile != NULL)
+	writeresults(outfile, tracefiles, num_tracefiles, 
+		     run_libc ? libc_stats : NULL, mm_stats, 
+		     warmup, samples, perfindex);
+
     if (autograder) {
 	printf("correct:%d\n", numcorrect);
 	printf("perfidx:%.0f\n", perfindex);
@@ -366,23 +518,246 @@ int main(int argc, char **argv)
 }
 
 
+/*****************************************************************
+ * AN: The following routines evaluate whole traces, for eval_traces
+ * in workers.c, which runs them one after another or in worker 
+ * processes. What they time goes between timing_begin and timing_end.
+ * The threads of a threaded replay are pinned to the CPUs of 
+ * workers.c in order, whichever worker runs it.
+ ****************************************************************/
+
+/*
+ * eval_libc_trace - AN: check and time libc malloc on one trace
+ */
+static void eval_libc_trace(char *filename, int tracenum, stats_t *stats)
+{
+    trace_t *trace = read_trace(tracedir, filename);
+    speed_t speed_params;
+
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking libc malloc for correctness, ");
+    stats->valid = eval_libc_valid(trace, tracenum);
+    if (stats->valid) {
+	speed_params.trace = trace;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	timing_begin();
+	stats->secs = fsecs(eval_libc_speed, &speed_params);
+	fsecs_dist(&stats->dist);
+	timing_end();
+    }
+    free_trace(trace);
+}
+
+/*
+ * eval_mm_trace - AN: check, measure and time mm malloc on one trace
+ */
+static void eval_mm_trace(char *filename, int tracenum, stats_t *stats)
+{
+    trace_t *trace = read_trace(tracedir, filename);
+    speed_t speed_params;
+    mem_arena_t *base_arena;
+
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, tracenum, &trace_ranges);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+	stats->util = eval_mm_util(trace, tracenum, &trace_ranges, &stats->rss);
+	/* AN: read before eval_mm_speed resets the heap */
+	stats->large = (double)mem_peak_regions() / 
+	    (double)mem_peak_footprint();
+	stats->peak = mem_peak_footprint();
+	stats->final = mem_footprint();
+	stats->released = mem_released();
+	sbrk_summary(stats);
+	speed_params.trace = trace;
+	speed_params.ranges = trace_ranges;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	timing_begin();
+	stats->secs = fsecs(eval_mm_speed, &speed_params);
+	fsecs_dist(&stats->dist);
+	/* AN: the same measurement with the huge page heap */
+	if (huge_arena != NULL) {
+	    base_arena = mem_arena_use(huge_arena);
+	    stats->hsecs = fsecs(eval_mm_speed, &speed_params);
+	    mem_arena_use(base_arena);
+	}
+	/* AN: and the replays of a thread-tagged trace on threads */
+	if (trace->threads > 0)
+	    eval_mm_threads(trace, stats);
+	/* AN: and the hardware events of one more, untimed run */
+	if (count_events) {
+	    stats->nevents = perfctr_measure(eval_mm_speed, &speed_params, 
+					     stats->events);
+	    stats->events_errno = perfctr_errno();
+	}
+	/* AN: and the latency of each request of another */
+	if (time_requests)
+	    eval_mm_latency(trace, stats);
+	timing_end();
+    }
+    free_trace(trace);
+}
+
 /*****************************************************************
  * The following routines manipulate the range list, which keeps 
  * track of the extent of every allocated block payload. We use the 
  * range list to detect any overlapping allocated blocks.
+ * AN: the "list" is now an AVL tree ordered by lo. Payloads never 
+ * overlap, so a new payload can only overlap its neighbours in that 
+ * order, and each check or removal is O(log n). The records come from
+ * slabs of RANGE_SLAB records that are kept for the next trace.
  ****************************************************************/
 
+#define RANGE_HEIGHT(p) ((p) ? (p)->height : 0)
+
+/* range_new - AN: take a record off the free list, refilling it from a 
+ *     new slab when it is empty */
+static range_t *range_new(void)
+{
+    range_slab_t *slab;
+    range_t *p;
+    int i;
+
+    if (range_free == NULL) {
+	if ((slab = (range_slab_t *)malloc(sizeof(range_slab_t))) == NULL)
+	    unix_error("malloc error in range_new");
+	slab->next = range_slabs;
+	range_slabs = slab;
+	for (i = 0; i < RANGE_SLAB; i++) {
+	    slab->ranges[i].left = range_free;
+	    range_free = &slab->ranges[i];
+	}
+    }
+
+    p = range_free;
+    range_free = p->left;
+    return p;
+}
+
+/* range_dispose - AN: put a record back on the free list */
+static void range_dispose(range_t *p)
+{
+    p->left = range_free;
+    range_free = p;
+}
+
+/* AN: AVL tree helpers, as for the size tree in mm.c */
+static void range_update(range_t *p)
+{
+    int hl = RANGE_HEIGHT(p->left);
+    int hr = RANGE_HEIGHT(p->right);
+
+    p->height = ((hl > hr) ? hl : hr) + 1;
+}
+
+static range_t *range_rotate_right(range_t *p)
+{
+    range_t *l = p->left;
+
+    p->left = l->right;
+    l->right = p;
+    range_update(p);
+    range_update(l);
+    return l;
+}
+
+static range_t *range_rotate_left(range_t *p)
+{
+    range_t *r = p->right;
+
+    p->right = r->left;
+    r->left = p;
+    range_update(p);
+    range_update(r);
+    return r;
+}
+
+/* restore the AVL property at p after one of its subtrees changed */
+static range_t *range_balance(range_t *p)
+{
+    int hl = RANGE_HEIGHT(p->left);
+    int hr = RANGE_HEIGHT(p->right);
+
+    if (hl > hr + 1) {
+	if (RANGE_HEIGHT(p->left->left) < RANGE_HEIGHT(p->left->right))
+	    p->left = range_rotate_left(p->left);
+	return range_rotate_right(p);
+    }
+    if (hr > hl + 1) {
+	if (RANGE_HEIGHT(p->right->right) < RANGE_HEIGHT(p->right->left))
+	    p->right = range_rotate_right(p->right);
+	return range_rotate_left(p);
+    }
+    range_update(p);
+    return p;
+}
+
+static range_t *range_insert(range_t *root, range_t *p)
+{
+    if (root == NULL)
+	return p;
+    if (p->lo < root->lo)
+	root->left = range_insert(root->left, p);
+    else
+	root->right = range_insert(root->right, p);
+    return range_balance(root);
+}
+
+/* unlink the leftmost record of the subtree at root into *minp */
+static range_t *range_remove_min(range_t *root, range_t **minp)
+{
+    if (root->left == NULL) {
+	*minp = root;
+	return root->right;
+    }
+    root->left = range_remove_min(root->left, minp);
+    return range_balance(root);
+}
+
+/* unlink the record starting at lo, if any, into *hitp */
+static range_t *range_remove(range_t *root, char *lo, range_t **hitp)
+{
+    range_t *succ, *right;
+
+    if (root == NULL)
+	return NULL;
+    if (lo < root->lo) {
+	root->left = range_remove(root->left, lo, hitp);
+	return range_balance(root);
+    }
+    if (lo > root->lo) {
+	root->right = range_remove(root->right, lo, hitp);
+	return range_balance(root);
+    }
+
+    *hitp = root;
+    if (root->left == NULL)
+	return root->right;
+    if (root->right == NULL)
+	return root->left;
+    right = range_remove_min(root->right, &succ);
+    succ->left = root->left;
+    succ->right = right;
+    return range_balance(succ);
+}
+
 /*
  * add_range - As directed by request opnum in trace tracenum,
  *     we've just called the student's mm_malloc to allocate a block of 
  *     size bytes at addr lo. After checking the block for correctness,
  *     we create a range struct for this block and add it to the range list. 
  */
-static int add_range(range_t **ranges, char *lo, int size, 
-		     int tracenum, int opnum)
+static int add_range(range_t **ranges, char *lo, size_t size, 
+		     int tracenum, long opnum)
 {
     char *hi = lo + size - 1;
-    range_t *p;
+    range_t *p, *pred = NULL, *succ = NULL;
     char msg[MAXLINE];
 
     assert(size > 0);
@@ -396,8 +771,10 @@ static int add_range(range_t **ranges, char *lo, int size,
     }
 
     /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* AN: or within a region mapped for a large object */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_is_mapped(lo, hi)) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
@@ -405,26 +782,35 @@ static int add_range(range_t **ranges, char *lo, int size,
     }
 
     /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    /* AN: only the last payload starting at or before lo, and the first
+     * one starting after it, can */
+    for (p = *ranges;  p != NULL;  ) {
+	if (p->lo <= lo) {
+	    pred = p;
+	    p = p->right;
+	} else {
+	    succ = p;
+	    p = p->left;
+	}
+    }
+    if (((p = pred) != NULL && p->hi >= lo) || 
+	((p = succ) != NULL && p->lo <= hi)) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, p->lo, p->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
     }
 
     /* 
      * Everything looks OK, so remember the extent of this block 
      * by creating a range struct and adding it the range list.
      */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
+    p = range_new();
     p->lo = lo;
     p->hi = hi;
-    *ranges = p;
+    p->left = p->right = NULL;
+    p->height = 1;
+    *ranges = range_insert(*ranges, p);
     return 1;
 }
 
@@ -433,19 +819,11 @@ static int add_range(range_t **ranges, char *lo, int size,
  */
 static void remove_range(range_t **ranges, char *lo)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-    int size;
-
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
-    }
+    range_t *p = NULL;
+
+    *ranges = range_remove(*ranges, lo, &p);
+    if (p != NULL)
+	range_dispose(p);
 }
 
 /*
@@ -453,119 +831,17 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-    range_t *p;
-    range_t *pnext;
+    range_t *p = *ranges;
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
-    }
+    if (p == NULL)
+	return;
+    clear_ranges(&p->left);
+    clear_ranges(&p->right);
+    range_dispose(p);
     *ranges = NULL;
 }
 
 
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
-
-/*
- * read_trace - read a trace file and store it in memory
- */
-static trace_t *read_trace(char *tracedir, char *filename)
-{
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
-    char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
-
-    if (verbose > 1)
-	printf("Reading tracefile: %s\n", filename);
-
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
-    }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
-	    break;
-	case 'f':
-	    fscanf(tracefile, "%ud", &index);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
-	    break;
-	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
-	}
-	op_index++;
-	
-    }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
-    return trace;
-}
-
-/*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
- */
-void free_trace(trace_t *trace)
-{
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
-}
-
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -576,10 +852,10 @@ void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
 {
-    int i, j;
+    long i;
     int index;
-    int size;
-    int oldsize;
+    size_t j, size, oldsize;
+    traceop_t *op;
     char *newp;
     char *oldp;
     char *p;
@@ -595,11 +871,11 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     }
 
     /* Interpret each operation in the trace in order */
-    for (i = 0;  i < trace->num_ops;  i++) {
-	index = trace->ops[i].index;
-	size = trace->ops[i].size;
+    for (trace_rewind(trace), i = 0;  (op = TRACE_NEXT(trace)) != NULL;  i++) {
+	index = op->index;
+	size = op->size;
 
-        switch (trace->ops[i].type) {
+        switch (op->type) {
 
         case ALLOC: /* mm_malloc */
 
@@ -625,14 +901,13 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    memset(p, index & 0xFF, size);
 
 	    /* Remember region */
-	    trace->blocks[index] = p;
-	    trace->block_sizes[index] = size;
+	    block_set(trace, index, p, size);
 	    break;
 
         case REALLOC: /* mm_realloc */
 	    
 	    /* Call the student's realloc */
-	    oldp = trace->blocks[index];
+	    oldp = block_of(trace, index)->p;
 	    if ((newp = mm_realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
@@ -649,11 +924,13 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	     * Make sure that the new block contains the data from the old 
 	     * block and then fill in the new block with the low order byte
 	     * of the new index
+	     * AN: as unsigned bytes; a char is signed here, and every id 
+	     * whose low byte is 128 or more failed
 	     */
-	    oldsize = trace->block_sizes[index];
+	    oldsize = block_of(trace, index)->size;
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -662,14 +939,14 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    memset(newp, index & 0xFF, size);
 
 	    /* Remember region */
-	    trace->blocks[index] = newp;
-	    trace->block_sizes[index] = size;
+	    block_set(trace, index, newp, size);
 	    break;
 
         case FREE: /* mm_free */
 	    
 	    /* Remove region from list and call student's free function */
-	    p = trace->blocks[index];
+	    p = block_of(trace, index)->p;
+	    block_drop(trace, index);
 	    remove_range(ranges, p);
 	    mm_free(p);
 	    break;
@@ -693,36 +970,47 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   package on the trace. Note that our implementation of mem_sbrk() 
  *   doesn't allow the students to decrement the brk pointer, so brk
  *   is always the high water mark of the heap. 
+ *   AN: large objects live in regions mapped outside the heap, which are
+ *   unmapped again when freed, so heapsize is now the peak footprint of
+ *   heap plus regions, as recorded by memlib.
+ *   AN: *rss gets the same ratio against the peak resident set instead,
+ *   sampled with mem_resident every RSS_INTERVAL ops and whenever the 
+ *   payload reaches a new high. Payloads are written as they are 
+ *   allocated, the way a program would.
  *   
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
+static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges,
+			   double *rss)
 {   
-    int i;
+    long i;
+    traceop_t *op;
+    size_t resident, max_resident = 0;
     int index;
-    int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
+    size_t size, newsize, oldsize;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
     char *p;
     char *newp, *oldp;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
+    mem_release_heap();  /* AN: pages of earlier runs are not ours */
     if (mm_init() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+    for (trace_rewind(trace), i = 0;  (op = TRACE_NEXT(trace)) != NULL;  i++) {
+        switch (op->type) {
 
         case ALLOC: /* mm_alloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
+	    index = op->index;
+	    size = op->size;
 
 	    if ((p = mm_malloc(size)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
+	    memset(p, 0, size);
 	    
 	    /* Remember region and size */
-	    trace->blocks[index] = p;
-	    trace->block_sizes[index] = size;
+	    block_set(trace, index, p, size);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -734,17 +1022,18 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    break;
 
 	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
-	    oldsize = trace->block_sizes[index];
+	    index = op->index;
+	    newsize = op->size;
+	    oldsize = block_of(trace, index)->size;
 
-	    oldp = trace->blocks[index];
+	    oldp = block_of(trace, index)->p;
 	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
+	    if (newsize > oldsize)
+		memset(newp + oldsize, 0, newsize - oldsize);
 
 	    /* Remember region and size */
-	    trace->blocks[index] = newp;
-	    trace->block_sizes[index] = newsize;
+	    block_set(trace, index, newp, newsize);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -756,9 +1045,10 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    break;
 
         case FREE: /* mm_free */
-	    index = trace->ops[i].index;
-	    size = trace->block_sizes[index];
-	    p = trace->blocks[index];
+	    index = op->index;
+	    size = block_of(trace, index)->size;
+	    p = block_of(trace, index)->p;
+	    block_drop(trace, index);
 	    
 	    mm_free(p);
 	    
@@ -772,9 +1062,16 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    app_error("Nonexistent request type in eval_mm_util");
 
         }
+
+	/* AN: sample the resident set */
+	if (((i % RSS_INTERVAL) == 0) || (total_size == max_total_size)) {
+	    resident = mem_resident();
+	    max_resident = (resident > max_resident) ? resident : max_resident;
+	}
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    *rss = (double)max_total_size / (double)max_resident;
+    return ((double)max_total_size / (double)mem_peak_footprint());
 }
 
 
@@ -784,7 +1081,10 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    long i;
+    int index;
+    size_t size, newsize;
+    traceop_t *op;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -794,29 +1094,30 @@ static void eval_mm_speed(void *ptr)
 	app_error("mm_init failed in eval_mm_speed");
 
     /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
-        switch (trace->ops[i].type) {
+    for (trace_rewind(trace), i = 0;  (op = TRACE_NEXT(trace)) != NULL;  i++)
+        switch (op->type) {
 
         case ALLOC: /* mm_malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
+            index = op->index;
+            size = op->size;
             if ((p = mm_malloc(size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
-            trace->blocks[index] = p;
+            block_set(trace, index, p, size);
             break;
 
 	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
+	    index = op->index;
+            newsize = op->size;
+	    oldp = block_of(trace, index)->p;
             if ((newp = mm_realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc error in eval_mm_speed");
-            trace->blocks[index] = newp;
+            block_set(trace, index, newp, newsize);
             break;
 
         case FREE: /* mm_free */
-            index = trace->ops[i].index;
-            block = trace->blocks[index];
+            index = op->index;
+            block = block_of(trace, index)->p;
+	    block_drop(trace, index);
             mm_free(block);
             break;
 
@@ -825,6 +1126,338 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * eval_mm_latency - AN: time every request of one more run of the trace
+ *     with read_counter, into histograms per request type and size 
+ *     class, and keep their percentiles and the LAT_WORST slowest 
+ *     requests in stats. A run of warmup makes the heap's pages resident
+ *     first, as they are for the timed runs.
+ */
+static void eval_mm_latency(trace_t *trace, stats_t *stats)
+{
+    latency_run_t *lr;
+    speed_t speed_params;
+    unsigned long long t0, t1;
+    double mhz = counter_mhz();
+    unsigned long long allmax;
+    long all[HIST_BUCKETS];
+    int i, c, b;
+
+    if ((lr = (latency_run_t *)calloc(1, sizeof(latency_run_t))) == NULL)
+	unix_error("calloc failed in eval_mm_latency");
+    lr->trace = trace;
+
+    /* the cost of the reads themselves, taken off every request */
+    lr->overhead = (unsigned long long)-1;
+    for (i = 0; i < 1000; i++) {
+	t0 = read_counter();
+	t1 = read_counter();
+	if (t1 - t0 < lr->overhead)
+	    lr->overhead = t1 - t0;
+    }
+
+    speed_params.trace = trace;
+    eval_mm_speed(&speed_params);
+    eval_mm_latency_run(lr);
+
+    /* each size class, then all of them together */
+    for (i = 0; i < LAT_TYPES; i++) {
+	memset(all, 0, sizeof(all));
+	allmax = 0;
+	for (c = 0; c < LAT_CLASSES; c++) {
+	    for (b = 0; b < HIST_BUCKETS; b++)
+		all[b] += lr->hist[i][c][b];
+	    if (lr->max[i][c] > allmax)
+		allmax = lr->max[i][c];
+	    latency_summary(&stats->lat[i][c], lr->hist[i][c], 
+			    lr->max[i][c], mhz);
+	}
+	latency_summary(&stats->lat[i][LAT_CLASSES], all, allmax, mhz);
+    }
+    for (i = 0; i < LAT_WORST; i++) {
+	stats->worst[i] = lr->worst[i];
+	stats->worst[i].ns = lr->worst[i].ns / mhz * 1e3;
+    }
+    free(lr);
+}
+
+/*
+ * eval_mm_latency_run - AN: eval_mm_speed, with every request timed
+ */
+static void eval_mm_latency_run(void *ptr)
+{
+    latency_run_t *lr = (latency_run_t *)ptr;
+    trace_t *trace = lr->trace;
+    unsigned long long t0, t1;
+    traceop_t *op;
+    size_t size;
+    char *p;
+    long i;
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_latency_run");
+
+    for (trace_rewind(trace), i = 0;  (op = TRACE_NEXT(trace)) != NULL;  i++) {
+        switch (op->type) {
+        case ALLOC:
+	    t0 = read_counter();
+	    p = mm_malloc(op->size);
+	    t1 = read_counter();
+	    if (p == NULL)
+		app_error("mm_malloc error in eval_mm_latency_run");
+	    block_set(trace, op->index, p, op->size);
+	    latency_record(lr, i, ALLOC, op->size, t1 - t0);
+            break;
+
+	case REALLOC:
+	    p = block_of(trace, op->index)->p;
+	    t0 = read_counter();
+	    p = mm_realloc(p, op->size);
+	    t1 = read_counter();
+	    if (p == NULL)
+		app_error("mm_realloc error in eval_mm_latency_run");
+	    block_set(trace, op->index, p, op->size);
+	    latency_record(lr, i, REALLOC, op->size, t1 - t0);
+            break;
+
+        case FREE:
+	    p = block_of(trace, op->index)->p;
+	    size = block_of(trace, op->index)->size;
+	    block_drop(trace, op->index);
+	    t0 = read_counter();
+	    mm_free(p);
+	    t1 = read_counter();
+	    latency_record(lr, i, FREE, size, t1 - t0);
+            break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_latency_run");
+        }
+    }
+}
+
+/*
+ * latency_record - AN: count request i of the given type and size, which
+ *     took ticks, in its histogram, and among the slowest if it is
+ */
+static void latency_record(latency_run_t *lr, long i, int type, size_t size,
+			   unsigned long long ticks)
+{
+    int c, k;
+
+    ticks = (ticks > lr->overhead) ? ticks - lr->overhead : 0;
+    for (c = 0; size > lat_class_max[c]; c++)
+	;
+    lr->hist[type][c][hist_bucket(ticks)]++;
+    if (ticks > lr->max[type][c])
+	lr->max[type][c] = ticks;
+
+    /* the slowest requests, slowest first */
+    if (ticks <= lr->worst[LAT_WORST - 1].ns)
+	return;
+    for (k = LAT_WORST - 1; (k > 0) && (ticks > lr->worst[k - 1].ns); k--)
+	lr->worst[k] = lr->worst[k - 1];
+    lr->worst[k].opnum = i;
+    lr->worst[k].type = type;
+    lr->worst[k].size = size;
+    lr->worst[k].ns = ticks;
+}
+
+/*
+ * latency_summary - AN: the count, percentiles and maximum of one 
+ *     histogram, in ns
+ */
+static void latency_summary(latency_t *l, long *hist, 
+			    unsigned long long max, double mhz)
+{
+    int b;
+
+    l->count = 0;
+    for (b = 0; b < HIST_BUCKETS; b++)
+	l->count += hist[b];
+    l->max = max / mhz * 1e3;
+    l->p50 = MIN(hist_percentile(hist, l->count, 0.5) / mhz * 1e3, l->max);
+    l->p99 = MIN(hist_percentile(hist, l->count, 0.99) / mhz * 1e3, l->max);
+    l->p999 = MIN(hist_percentile(hist, l->count, 0.999) / mhz * 1e3, l->max);
+}
+
+/*
+ * hist_bucket, hist_value - AN: the histogram bucket of a value, and the
+ *     smallest value in a bucket. Values below 2*HIST_SUB have a bucket 
+ *     each; above that, each power of two is split into HIST_SUB equal 
+ *     buckets, so a bucket is never wider than 1/HIST_SUB of its values.
+ */
+static int hist_bucket(unsigned long long v)
+{
+    int shift;
+
+    if (v < 2*HIST_SUB)
+	return (int)v;
+    shift = (63 - __builtin_clzll(v)) - HIST_BITS;
+    return shift*HIST_SUB + (int)(v >> shift);
+}
+
+static unsigned long long hist_value(int b)
+{
+    int shift;
+
+    if (b < 2*HIST_SUB)
+	return b;
+    shift = b/HIST_SUB - 1;
+    return (unsigned long long)(b - shift*HIST_SUB) << shift;
+}
+
+/*
+ * hist_percentile - AN: the value at quantile q of a histogram of count
+ *     values, as the highest value of its bucket (0 if it is empty)
+ */
+static double hist_percentile(long *hist, long count, double q)
+{
+    long seen = 0, rank = (long)(q * count + 0.5);
+    int b;
+
+    if (count == 0)
+	return 0;
+    if (rank < 1)
+	rank = 1;
+    for (b = 0; b < HIST_BUCKETS - 1; b++)
+	if ((seen += hist[b]) >= rank)
+	    break;
+    return (double)(hist_value(b + 1) - 1);
+}
+
+/*
+ * eval_mm_threads - AN: time the replays of a thread-tagged trace on 1,
+ *     2, 4, ... threads and on as many as it has. With fewer threads than
+ *     the trace, thread t of the trace runs on thread t % nthreads.
+ */
+static void eval_mm_threads(trace_t *trace, stats_t *stats)
+{
+    replay_t *r;
+    int steps[THREAD_STEPS];
+    int s, t, nsteps;
+    long i;
+    cpu_set_t set;
+
+    if ((r = (replay_t *)calloc(1, sizeof(replay_t))) == NULL ||
+	(r->seqs = (int *)malloc(trace->num_ops * sizeof(int))) == NULL ||
+	(r->gens = (int *)calloc(trace->num_ids, sizeof(int))) == NULL)
+	unix_error("malloc failed in eval_mm_threads");
+    r->trace = trace;
+
+    /* the requests on an id are made in trace order, whatever thread 
+     * makes them */
+    for (i = 0; i < trace->num_ops; i++)
+	r->seqs[i] = r->gens[trace->ops[i].index]++;
+
+    for (t = 0; t < MAXTHREADS; t++) {
+	r->threads[t].replay = r;
+	pthread_attr_init(&r->attrs[t]);
+	if (ncpus > 0) {
+	    CPU_ZERO(&set);
+	    CPU_SET(cpus[t % ncpus], &set);
+	    pthread_attr_setaffinity_np(&r->attrs[t], sizeof(set), &set);
+	}
+    }
+
+    stats->threads = trace->threads;
+    nsteps = thread_steps(trace->threads, steps);
+    for (s = 0; s < nsteps; s++) {
+	r->nthreads = steps[s];
+	for (t = 0; t < r->nthreads; t++) {
+	    r->threads[t].nreqs = 0;
+	    if ((r->threads[t].reqs = 
+		 (long *)malloc(trace->num_ops * sizeof(long))) == NULL)
+		unix_error("malloc failed in eval_mm_threads");
+	}
+	for (i = 0; i < trace->num_ops; i++) {
+	    t = trace->tids[i] % r->nthreads;
+	    r->threads[t].reqs[r->threads[t].nreqs++] = i;
+	}
+	stats->tsecs[s] = fsecs(eval_mm_replay, r);
+	for (t = 0; t < r->nthreads; t++)
+	    free(r->threads[t].reqs);
+    }
+
+    for (t = 0; t < MAXTHREADS; t++)
+	pthread_attr_destroy(&r->attrs[t]);
+    free(r->seqs);
+    free(r->gens);
+    free(r);
+}
+
+/*
+ * eval_mm_replay - AN: replay a thread-tagged trace on r->nthreads 
+ *     threads of the mm malloc package, and wait for them
+ */
+static void eval_mm_replay(void *ptr)
+{
+    replay_t *r = (replay_t *)ptr;
+    pthread_t tids[MAXTHREADS];
+    int t;
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm_init() < 0) 
+	app_error("mm_init failed in eval_mm_replay");
+    memset(r->gens, 0, r->trace->num_ids * sizeof(int));
+
+    for (t = 0; t < r->nthreads; t++)
+	if (pthread_create(&tids[t], &r->attrs[t], replay_thread, 
+			   &r->threads[t]) != 0)
+	    app_error("pthread_create failed in eval_mm_replay");
+    for (t = 0; t < r->nthreads; t++)
+	pthread_join(tids[t], NULL);
+}
+
+/*
+ * replay_thread - AN: make the requests of one thread. A request waits 
+ *     until the one before it on the same id is made, which is how a 
+ *     block freed or reallocated by another thread than the one that
+ *     got it is passed on.
+ */
+static void *replay_thread(void *ptr)
+{
+    replay_thread_t *self = (replay_thread_t *)ptr;
+    trace_t *trace = self->replay->trace;
+    int *gens = self->replay->gens;
+    block_t *b;
+    traceop_t *op;
+    char *p;
+    long k;
+    int seq;
+
+    for (k = 0; k < self->nreqs; k++) {
+	op = &trace->ops[self->reqs[k]];
+	seq = self->replay->seqs[self->reqs[k]];
+	while (__atomic_load_n(&gens[op->index], __ATOMIC_ACQUIRE) != seq)
+	    sched_yield();
+
+	b = &trace->blocks[op->index];
+	switch (op->type) {
+	case ALLOC:
+	    if ((p = mm_malloc(op->size)) == NULL)
+		app_error("mm_malloc error in replay_thread");
+	    b->p = p;
+	    break;
+	case REALLOC:
+	    if ((p = mm_realloc(b->p, op->size)) == NULL)
+		app_error("mm_realloc error in replay_thread");
+	    b->p = p;
+	    break;
+	case FREE:
+	    mm_free(b->p);
+	    break;
+	default:
+	    app_error("Nonexistent request type in replay_thread");
+	}
+	__atomic_store_n(&gens[op->index], seq + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -833,32 +1466,35 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
-    int i, newsize;
+    long i;
+    size_t newsize;
+    traceop_t *op;
     char *p, *newp, *oldp;
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+    for (trace_rewind(trace), i = 0;  (op = TRACE_NEXT(trace)) != NULL;  i++) {
+        switch (op->type) {
 
         case ALLOC: /* malloc */
-	    if ((p = malloc(trace->ops[i].size)) == NULL) {
+	    if ((p = malloc(op->size)) == NULL) {
 		malloc_error(tracenum, i, "libc malloc failed");
 		unix_error("System message");
 	    }
-	    trace->blocks[trace->ops[i].index] = p;
+	    block_set(trace, op->index, p, op->size);
 	    break;
 
 	case REALLOC: /* realloc */
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[trace->ops[i].index];
+            newsize = op->size;
+	    oldp = block_of(trace, op->index)->p;
 	    if ((newp = realloc(oldp, newsize)) == NULL) {
 		malloc_error(tracenum, i, "libc realloc failed");
 		unix_error("System message");
 	    }
-	    trace->blocks[trace->ops[i].index] = newp;
+	    block_set(trace, op->index, newp, newsize);
 	    break;
 	    
         case FREE: /* free */
-	    free(trace->blocks[trace->ops[i].index]);
+	    free(block_of(trace, op->index)->p);
+	    block_drop(trace, op->index);
 	    break;
 
 	default:
@@ -876,34 +1512,37 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
-    int index, size, newsize;
+    long i;
+    int index;
+    size_t size, newsize;
+    traceop_t *op;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+    for (trace_rewind(trace), i = 0;  (op = TRACE_NEXT(trace)) != NULL;  i++) {
+        switch (op->type) {
         case ALLOC: /* malloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
+	    index = op->index;
+	    size = op->size;
 	    if ((p = malloc(size)) == NULL)
 		unix_error("malloc failed in eval_libc_speed");
-	    trace->blocks[index] = p;
+	    block_set(trace, index, p, size);
 	    break;
 
 	case REALLOC: /* realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
+	    index = op->index;
+	    newsize = op->size;
+	    oldp = block_of(trace, index)->p;
 	    if ((newp = realloc(oldp, newsize)) == NULL)
 		unix_error("realloc failed in eval_libc_speed\n");
 	    
-	    trace->blocks[index] = newp;
+	    block_set(trace, index, newp, newsize);
 	    break;
 	    
         case FREE: /* free */
-	    index = trace->ops[i].index;
-	    block = trace->blocks[index];
+	    index = op->index;
+	    block = block_of(trace, index)->p;
+	    block_drop(trace, index);
 	    free(block);
 	    break;
 	}
@@ -916,60 +1555,27 @@ static void eval_libc_speed(void *ptr)
 
 
 /*
- * printresults - prints a performance summary for some malloc package
+ * sbrk_summary - AN: summarize memlib's log of sbrk events for the
+ *     trace that was just run by eval_mm_util
  */
-static void printresults(int n, stats_t *stats) 
+static void sbrk_summary(stats_t *stats)
 {
-    int i;
-    double secs = 0;
-    double ops = 0;
-    double util = 0;
-
-    /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-	   "trace", " valid", "util", "ops", "secs", "Kops");
-    for (i=0; i < n; i++) {
-	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
-		   i,
-		   "yes",
-		   stats[i].util*100.0,
-		   stats[i].ops,
-		   stats[i].secs,
-		   (stats[i].ops/1e3)/stats[i].secs);
-	    secs += stats[i].secs;
-	    ops += stats[i].ops;
-	    util += stats[i].util;
-	}
-	else {
-	    printf("%2d%10s%6s%8s%10s%6s\n", 
-		   i,
-		   "no",
-		   "-",
-		   "-",
-		   "-",
-		   "-");
+    const mem_sbrk_event_t *events;
+    size_t i, n;
+
+    n = mem_sbrk_events(&events);
+    stats->grows = stats->shrinks = 0;
+    stats->grown = stats->maxstep = 0;
+    for (i = 0; i < n; i++) {
+	if (events[i].incr > 0) {
+	    stats->grows++;
+	    stats->grown += events[i].incr;
+	    if (events[i].incr > stats->maxstep)
+		stats->maxstep = events[i].incr;
 	}
+	else if (events[i].incr < 0)
+	    stats->shrinks++;
     }
-
-    /* Print the aggregate results for the set of traces */
-    if (errors == 0) {
-	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
-	       "Total       ",
-	       (util/n)*100.0,
-	       ops, 
-	       secs,
-	       (ops/1e3)/secs);
-    }
-    else {
-	printf("%12s%6s%8s%10s%6s\n", 
-	       "Total       ",
-	       "-", 
-	       "-", 
-	       "-", 
-	       "-");
-    }
-
 }
 
 /* 
@@ -993,10 +1599,37 @@ void unix_error(char *msg)
 /*
  * malloc_error - Report an error returned by the mm_malloc package
  */
-void malloc_error(int tracenum, int opnum, char *msg)
+void malloc_error(int tracenum, long opnum, char *msg)
 {
     errors++;
-    printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
+    printf("ERROR [trace %d, line %ld]: %s\n", tracenum, LINENUM(opnum), msg);
+}
+
+/*
+ * parse_size - AN: read a byte count with an optional K, M or G suffix
+ */
+static size_t parse_size(char *arg)
+{
+    char *end;
+    unsigned long long size = strtoull(arg, &end, 10);
+
+    switch (*end) {
+    case 'G': case 'g':
+	size <<= 10;
+	/* fall through */
+    case 'M': case 'm':
+	size <<= 10;
+	/* fall through */
+    case 'K': case 'k':
+	size <<= 10;
+	end++;
+	break;
+    }
+    if ((end == arg) || (*end != '\0') || (size == 0)) {
+	usage();
+	exit(1);
+    }
+    return (size_t)size;
 }
 
 /* 
@@ -1004,14 +1637,29 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValCeFLSP] [-f <file>] [-t <dir>] [-m <size>] [-H thp|tlb] [-j <n>]\n"
+	    "               [-w <n>] [-n <n>] [-c <cpu>] [-o <file>] [-T <timer>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-c <cpu>   Pin the driver (and its workers and threads) to <cpu>.\n");
+    fprintf(stderr, "\t-C         Don't use or write .repb trace caches.\n");
+    fprintf(stderr, "\t-e         Count hardware events on a run of each trace.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-F         Use deferred coalescing (fast bins) in mm.c.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H <kind>  Time each trace on huge pages (thp or tlb) as well.\n");
+    fprintf(stderr, "\t-j <n>     Evaluate traces in <n> pinned workers, one per CPU but the timing CPU at most (0: that many).\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-L         Time each request of a run of each trace.\n");
+    fprintf(stderr, "\t-n <n>     Time <n> runs of each trace one by one (up to %d).\n", FSECS_MAXSAMPLES);
+    fprintf(stderr, "\t-o <file>  Also write the results to <file> (.json, or .csv).\n");
+    fprintf(stderr, "\t-m <size>  Reserve <size> bytes for the heap (suffix K, M or G).\n");
+    fprintf(stderr, "\t-P         With -j, time traces in parallel on all CPUs rather than one at a time on the first.\n");
+    fprintf(stderr, "\t-S         Stream traces in chunks rather than load them.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <timer> Time with fcyc (cycle counter), itimer, gettod or clock.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-w <n>     Run each trace <n> times untimed before its timed runs.\n");
 }
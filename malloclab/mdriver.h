@@ -0,0 +1,15 @@
+/*
+ * mdriver.h - AN: what the parts of the driver (mdriver.c, trace.c, 
+ *     stats.c and workers.c) share
+ */
+
+#define MAXLINE     1024 /* max string size */
+
+extern int verbose;      /* -v, -V */
+extern int errors;       /* errs found when running student malloc */
+extern int time_requests;/* -L */
+extern char msg[];       /* for whenever we need to compose an error message */
+
+/* Report an arbitrary application error, or a Unix-style error, and exit */
+void app_error(char *msg);
+void unix_error(char *msg);
@@ -2,7 +2,45 @@
  * memlib.c - a module that simulates the memory system.  Needed because it 
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
+ *
+ * AN: Besides the sbrk heap, memlib hands out page-aligned regions mapped
+ * outside the heap (mem_map/mem_remap/mem_unmap), which mm.c uses for
+ * large objects. The footprint of the simulated process is the heap plus
+ * all mapped regions; memlib remembers its peak, and how much of that
+ * peak was in regions, for the driver's utilization figures.
+ *
+ * AN: The heap itself is no longer carved out of libc's heap. mem_init 
+ * reserves mem_max_heap bytes of address space with mmap, inaccessible 
+ * and without swap reservation, and mem_sbrk commits (makes readable and
+ * writable) whole MEM_COMMIT_GRAIN steps of it as the break first passes
+ * them. A reservation of several GB costs nothing until it is touched.
+ *
+ * AN: All of this state lives in an arena (mem_arena_t), and any number
+ * of arenas can exist side by side, each with its own reserved range,
+ * break, regions, peak and sbrk log: mem_arena_create/mem_arena_sbrk/
+ * mem_arena_lo/mem_arena_hi and so on. The original single heap 
+ * interface (mem_init, mem_sbrk, ...) works on a default arena created 
+ * by mem_init. An arena is not thread safe; its user serializes access.
+ *
+ * AN: An arena's heap can be backed by huge pages (mem_arena_create_pages).
+ * MEM_PAGES_THP reserves a 2 MB aligned range, asks for transparent huge
+ * pages with madvise(MADV_HUGEPAGE) and commits whole 2 MB steps, so the
+ * kernel can map every committed step with one TLB entry. MEM_PAGES_HUGETLB
+ * maps the range from the hugetlbfs pool (MAP_HUGETLB) instead; without
+ * such a pool it falls back to THP. That mapping is made with 
+ * MAP_NORESERVE like the others, so the pool only gives up the huge pages
+ * the heap touches, however much is reserved; a heap that touches more 
+ * than the pool holds dies of SIGBUS rather than failing mem_sbrk.
+ *
+ * AN: Committed is not resident. mem_arena_release lets the allocator 
+ * hand whole pages of free memory back with madvise(MADV_DONTNEED); they
+ * stay committed and read as zeros when touched again, and the allocator
+ * says so with mem_arena_reclaim. Shrinking the break releases the pages
+ * above it the same way, and growing it reclaims them. mem_arena_resident 
+ * counts the pages of heap and regions actually in memory with mincore,
+ * which is what the driver's resident set utilization is based on.
  */
+#define _GNU_SOURCE /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -14,24 +52,78 @@
 #include "memlib.h"
 #include "config.h"
 
+/* AN: regions mapped outside the heap, as the nodes of an AVL tree 
+ * ordered by start, so a region is found in O(log n) */
+typedef struct mem_region_t {
+    char *start;                /* first byte of the region */
+    size_t size;                /* mapped bytes, a multiple of the page size */
+    struct mem_region_t *left;  /* regions at lower addresses */
+    struct mem_region_t *right; /* regions at higher addresses */
+    int height;                 /* of the subtree */
+} mem_region_t;
+
+/* AN: one simulated memory system */
+struct mem_arena_t {
+    char *start_brk;            /* points to first byte of heap */
+    char *brk;                  /* points to last byte of heap */
+    char *max_addr;             /* largest legal heap address */
+    char *commit_brk;           /* end of the committed part of the heap */
+    size_t max_heap;            /* bytes reserved for the heap */
+    size_t commit_grain;        /* bytes committed at a time */
+    int pages;                  /* MEM_PAGES_xxx backing of the heap */
+
+    mem_region_t *regions;      /* root of the tree of mapped regions */
+    size_t region_bytes;        /* bytes mapped in regions */
+    size_t peak_bytes;          /* peak of heap size + region bytes */
+    size_t peak_region_bytes;   /* region bytes at that peak */
+
+    size_t released_bytes;      /* bytes released and not reclaimed */
+    char *released_brk;         /* pages from the break to here released */
+    unsigned char *incore;      /* mincore vector for mem_arena_resident */
+    size_t incore_pages;        /* room in incore */
+
+    mem_sbrk_event_t *events;   /* sbrk events since the last reset */
+    size_t nevents;             /* events logged */
+    size_t maxevents;           /* room in events */
+};
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_arena_t *mem_default;       /* AN: the arena of mem_init */
+static size_t mem_max_heap = MAX_HEAP; /* AN: bytes reserved for it */
+
+#define MEM_COMMIT_GRAIN (1<<16)   /* AN: bytes committed at a time */
+#define MEM_HUGEPAGE (1<<21)       /* AN: size (and alignment) of a huge page */
+
+static void mem_update_peak(mem_arena_t *a);
+static void mem_unmap_all(mem_arena_t *a);
+static void mem_log_sbrk(mem_arena_t *a, intptr_t incr);
+static unsigned long mem_page_mask(mem_arena_t *a, void *p);
+static size_t mem_incore(mem_arena_t *a, char *start, size_t pages);
+static size_t mem_incore_regions(mem_arena_t *a, mem_region_t *r);
+static mem_region_t *region_insert(mem_region_t *root, mem_region_t *r);
+static mem_region_t *region_remove(mem_region_t *root, char *start, 
+				   mem_region_t **hitp);
+static mem_region_t *region_find(mem_region_t *root, char *addr);
 
 /* 
  * mem_init - initialize the memory system model
+ *    AN: creates the default arena
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    if ((mem_default = mem_arena_create(mem_max_heap)) == NULL) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
+}
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+/*
+ * mem_set_max_heap - AN: set the bytes of address space mem_init reserves
+ *    for the heap (MAX_HEAP by default). Call it before mem_init.
+ */
+void mem_set_max_heap(size_t size)
+{
+    mem_max_heap = size;
 }
 
 /* 
@@ -39,57 +131,657 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    mem_arena_destroy(mem_default);
+    mem_default = NULL;
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_arena_default - AN: the arena behind the single heap interface
  */
-void mem_reset_brk()
+mem_arena_t *mem_arena_default(void)
+{
+    return mem_default;
+}
+
+/*
+ * mem_arena_create - AN: a new arena reserving max_heap bytes for its 
+ *    heap, or NULL if that much address space is not available.
+ */
+mem_arena_t *mem_arena_create(size_t max_heap)
+{
+    return mem_arena_create_pages(max_heap, MEM_PAGES_NORMAL);
+}
+
+/*
+ * mem_arena_create_pages - AN: mem_arena_create with the heap backed by
+ *    pages of the given MEM_PAGES_xxx kind
+ */
+mem_arena_t *mem_arena_create_pages(size_t max_heap, int pages)
+{
+    mem_arena_t *a;
+    char *p;
+    size_t lead;
+
+    if ((a = (mem_arena_t *)calloc(1, sizeof(mem_arena_t))) == NULL)
+	return NULL;
+
+    /* allocate the storage we will use to model the available VM */
+    /* AN: reserve it only; mem_arena_sbrk commits it as the heap grows */
+    a->max_heap = (max_heap + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    a->commit_grain = MEM_COMMIT_GRAIN;
+    a->pages = MEM_PAGES_NORMAL;
+    a->start_brk = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if (pages == MEM_PAGES_HUGETLB) {
+	a->max_heap = (max_heap + MEM_HUGEPAGE - 1) & ~(size_t)(MEM_HUGEPAGE - 1);
+	a->start_brk = mmap(NULL, a->max_heap, PROT_NONE, MAP_PRIVATE | 
+			    MAP_ANONYMOUS | MAP_HUGETLB | MAP_NORESERVE, -1, 0);
+	if (a->start_brk != MAP_FAILED) {
+	    a->pages = MEM_PAGES_HUGETLB;
+	    a->commit_grain = MEM_HUGEPAGE;
+	}
+	else
+	    fprintf(stderr, "mem_arena_create: no hugetlb pages, using THP\n");
+    }
+#endif
+
+    if ((pages != MEM_PAGES_NORMAL) && (a->start_brk == MAP_FAILED)) {
+	/* over-reserve by a huge page and trim to a 2 MB aligned range */
+	a->max_heap = (max_heap + MEM_HUGEPAGE - 1) & ~(size_t)(MEM_HUGEPAGE - 1);
+	p = mmap(NULL, a->max_heap + MEM_HUGEPAGE, PROT_NONE, 
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (p != MAP_FAILED) {
+	    lead = (MEM_HUGEPAGE - ((unsigned long)p & (MEM_HUGEPAGE - 1))) & 
+		(MEM_HUGEPAGE - 1);
+	    if (lead)
+		munmap(p, lead);
+	    munmap(p + lead + a->max_heap, MEM_HUGEPAGE - lead);
+	    a->start_brk = p + lead;
+	    a->pages = MEM_PAGES_THP;
+	    a->commit_grain = MEM_HUGEPAGE;
+	    if (madvise(a->start_brk, a->max_heap, MADV_HUGEPAGE) < 0)
+		fprintf(stderr, "mem_arena_create: no transparent huge pages\n");
+	}
+    }
+
+    if (a->start_brk == MAP_FAILED)
+	a->start_brk = mmap(NULL, a->max_heap, PROT_NONE, 
+			    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (a->start_brk == MAP_FAILED) {
+	free(a);
+	return NULL;
+    }
+
+    a->max_addr = a->start_brk + a->max_heap;  /* max legal heap address */
+    a->brk = a->start_brk;                     /* heap is empty initially */
+    a->commit_brk = a->start_brk;              /* nothing committed yet */
+    return a;
+}
+
+/*
+ * mem_arena_destroy - AN: unmap the heap and regions of an arena
+ */
+void mem_arena_destroy(mem_arena_t *a)
 {
-    mem_brk = mem_start_brk;
+    mem_unmap_all(a);
+    munmap(a->start_brk, a->max_heap);
+    free(a->events);
+    free(a->incore);
+    free(a);
+}
+
+/*
+ * mem_arena_reset_brk - reset the simulated brk pointer to make an empty heap
+ *    AN: also releases all mapped regions and the peak footprint.
+ */
+void mem_arena_reset_brk(mem_arena_t *a)
+{
+    a->brk = a->start_brk;
+    mem_unmap_all(a);
+    a->peak_bytes = 0;
+    a->peak_region_bytes = 0;
+    a->released_bytes = 0;
+    a->released_brk = NULL;
+    a->nevents = 0;
 }
 
 /* 
- * mem_sbrk - simple model of the sbrk function. Extends the heap 
+ * mem_arena_sbrk - simple model of the sbrk function. Extends the heap 
  *    by incr bytes and returns the start address of the new area. In
  *    this model, the heap cannot be shrunk.
+ *    AN: it can now; a negative incr gives the top -incr bytes back, as
+ *    long as the break stays at or above the start of the heap. incr is
+ *    an intptr_t, so a heap of more than 2 GB can move by more than that.
  */
-void *mem_sbrk(int incr) 
+void *mem_arena_sbrk(mem_arena_t *a, intptr_t incr) 
 {
-    char *old_brk = mem_brk;
+    char *old_brk = a->brk;
+    unsigned long mask;
+    char *old_top, *top;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if ( ((a->brk + incr) < a->start_brk) || ((a->brk + incr) > a->max_addr)) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
-    mem_brk += incr;
+
+    /* AN: commit the reserved pages the new break reaches into */
+    if (a->brk + incr > a->commit_brk) {
+	size_t grain = (a->brk + incr - a->commit_brk + a->commit_grain - 1) &
+	    ~(a->commit_grain - 1);
+
+	if (grain > (size_t)(a->max_addr - a->commit_brk))
+	    grain = a->max_addr - a->commit_brk;
+	if (mprotect(a->commit_brk, grain, PROT_READ | PROT_WRITE) < 0) {
+	    errno = ENOMEM;
+	    fprintf(stderr, "ERROR: mem_sbrk failed. Could not commit memory...\n");
+	    return (void *)-1;
+	}
+	a->commit_brk += grain;
+    }
+
+    a->brk += incr;
+    mem_update_peak(a);
+    mem_log_sbrk(a, incr);
+
+    /* AN: pages the heap no longer covers leave the resident set, up to 
+     * the end of the page the old break was in; those it covers again 
+     * are reclaimed. The pages from the break to released_brk stay 
+     * released in between. */
+    mask = mem_page_mask(a, old_brk);
+    old_top = (char *)(((unsigned long)old_brk + mask) & ~mask);
+    if (incr < 0) {
+	mem_arena_release(a, a->brk, old_top - 1);
+	if (a->released_brk < old_top)
+	    a->released_brk = old_top;
+    }
+    else if (a->released_brk > old_top) {
+	top = (char *)(((unsigned long)a->brk + mask) & ~mask);
+	if (top > a->released_brk)
+	    top = a->released_brk;
+	mem_arena_reclaim(a, old_brk, top - 1);
+    }
     return (void *)old_brk;
 }
 
 /*
- * mem_heap_lo - return address of the first heap byte
+ * mem_arena_sbrk_events - AN: the sbrk events since the last reset,
+ *    oldest first. Returns their number and points *events at them.
  */
-void *mem_heap_lo()
+size_t mem_arena_sbrk_events(mem_arena_t *a, const mem_sbrk_event_t **events)
+{
+    *events = a->events;
+    return a->nevents;
+}
+
+/*
+ * mem_arena_map - AN: map a fresh region of at least size bytes outside 
+ *    the heap. Returns its page-aligned start, or (void *)-1 like sbrk.
+ */
+void *mem_arena_map(mem_arena_t *a, size_t size)
+{
+    mem_region_t *r;
+    char *start;
+
+    size = (size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    start = mmap(NULL, size, PROT_READ | PROT_WRITE, 
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (start == MAP_FAILED) {
+	errno = ENOMEM;
+	fprintf(stderr, "ERROR: mem_map failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+
+    if ((r = (mem_region_t *)malloc(sizeof(mem_region_t))) == NULL) {
+	fprintf(stderr, "mem_map: malloc error\n");
+	exit(1);
+    }
+    /* AN: a huge page arena asks for huge pages in big regions, too */
+    if ((a->pages != MEM_PAGES_NORMAL) && (size >= MEM_HUGEPAGE))
+	madvise(start, size, MADV_HUGEPAGE);
+
+    r->start = start;
+    r->size = size;
+    r->left = r->right = NULL;
+    r->height = 1;
+    a->regions = region_insert(a->regions, r);
+
+    a->region_bytes += size;
+    mem_update_peak(a);
+    return (void *)start;
+}
+
+/*
+ * mem_arena_remap - AN: resize a region to at least size bytes, possibly 
+ *    moving it. Returns the new start, or (void *)-1 with the region 
+ *    unchanged.
+ */
+void *mem_arena_remap(mem_arena_t *a, void *start, size_t size)
+{
+    mem_region_t *r;
+    char *newstart;
+
+    r = region_find(a->regions, start);
+    assert((r != NULL) && (r->start == (char *)start));
+
+    size = (size + mem_pagesize() - 1) & ~(mem_pagesize() - 1);
+    newstart = mremap(r->start, r->size, size, MREMAP_MAYMOVE);
+    if (newstart == MAP_FAILED) {
+	errno = ENOMEM;
+	fprintf(stderr, "ERROR: mem_remap failed. Ran out of memory...\n");
+	return (void *)-1;
+    }
+
+    a->region_bytes = a->region_bytes - r->size + size;
+    r->size = size;
+    if (newstart != r->start) {
+	/* a region that moved is filed under its new start */
+	a->regions = region_remove(a->regions, r->start, &r);
+	r->start = newstart;
+	r->left = r->right = NULL;
+	r->height = 1;
+	a->regions = region_insert(a->regions, r);
+    }
+    mem_update_peak(a);
+    return (void *)newstart;
+}
+
+/*
+ * mem_arena_unmap - AN: give a region back to the system
+ */
+void mem_arena_unmap(mem_arena_t *a, void *start)
+{
+    mem_region_t *r = NULL;
+
+    a->regions = region_remove(a->regions, (char *)start, &r);
+    assert(r != NULL);
+
+    munmap(r->start, r->size);
+    a->region_bytes -= r->size;
+    free(r);
+}
+
+/*
+ * mem_arena_is_mapped - AN: does [lo, hi] lie within one mapped region?
+ */
+int mem_arena_is_mapped(mem_arena_t *a, void *lo, void *hi)
+{
+    mem_region_t *r = region_find(a->regions, (char *)lo);
+
+    return (r != NULL) && ((char *)hi < r->start + r->size);
+}
+
+/*
+ * mem_arena_footprint - AN: current heap size plus mapped region bytes
+ */
+size_t mem_arena_footprint(mem_arena_t *a)
+{
+    return mem_arena_heapsize(a) + a->region_bytes;
+}
+
+/*
+ * mem_arena_peak_footprint - AN: peak of heap size plus mapped region 
+ *    bytes since the last reset
+ */
+size_t mem_arena_peak_footprint(mem_arena_t *a)
+{
+    return a->peak_bytes;
+}
+
+/*
+ * mem_arena_peak_regions - AN: bytes in mapped regions at the peak 
+ *    footprint
+ */
+size_t mem_arena_peak_regions(mem_arena_t *a)
+{
+    return a->peak_region_bytes;
+}
+
+/*
+ * mem_arena_release - AN: give the whole pages within [lo, hi] back to
+ *    the system. They stay committed and read as zeros when next touched.
+ *    A MAP_HUGETLB heap can only drop whole huge pages; madvise fails on
+ *    anything smaller.
+ */
+void mem_arena_release(mem_arena_t *a, void *lo, void *hi)
+{
+    unsigned long mask = mem_page_mask(a, lo);
+    char *start = (char *)(((unsigned long)lo + mask) & ~mask);
+    char *end = (char *)(((unsigned long)hi + 1) & ~mask);
+
+    if (end <= start)
+	return;
+    if (madvise(start, end - start, MADV_DONTNEED) == 0)
+	a->released_bytes += end - start;
+}
+
+/*
+ * mem_arena_reclaim - AN: the whole pages within [lo, hi], released 
+ *    before, are about to be used again; they no longer count as 
+ *    released. Rounds like mem_arena_release, so the same range takes 
+ *    back what it gave.
+ */
+void mem_arena_reclaim(mem_arena_t *a, void *lo, void *hi)
+{
+    unsigned long mask = mem_page_mask(a, lo);
+    char *start = (char *)(((unsigned long)lo + mask) & ~mask);
+    char *end = (char *)(((unsigned long)hi + 1) & ~mask);
+
+    if (end <= start)
+	return;
+    if ((size_t)(end - start) > a->released_bytes)
+	a->released_bytes = 0;
+    else
+	a->released_bytes -= end - start;
+}
+
+/*
+ * mem_page_mask - AN: size - 1 of the page at p, a huge page inside a 
+ *    MAP_HUGETLB heap
+ */
+static unsigned long mem_page_mask(mem_arena_t *a, void *p)
+{
+    if ((a->pages == MEM_PAGES_HUGETLB) && 
+	((char *)p >= a->start_brk) && ((char *)p < a->max_addr))
+	return MEM_HUGEPAGE - 1;
+    return mem_pagesize() - 1;
+}
+
+/*
+ * mem_arena_release_heap - AN: release every committed page of the heap,
+ *    so that a new measurement of the resident set starts from nothing.
+ *    Only for an empty heap; the contents are lost.
+ */
+void mem_arena_release_heap(mem_arena_t *a)
+{
+    if (a->commit_brk > a->start_brk)
+	madvise(a->start_brk, a->commit_brk - a->start_brk, MADV_DONTNEED);
+}
+
+/*
+ * mem_arena_released - AN: bytes released since the last reset and not
+ *    reclaimed since
+ */
+size_t mem_arena_released(mem_arena_t *a)
+{
+    return a->released_bytes;
+}
+
+/*
+ * mem_arena_committed - AN: committed bytes of the heap plus the bytes of
+ *    all mapped regions
+ */
+size_t mem_arena_committed(mem_arena_t *a)
+{
+    return (size_t)(a->commit_brk - a->start_brk) + a->region_bytes;
+}
+
+/*
+ * mem_arena_resident - AN: bytes of the committed heap and of the mapped
+ *    regions that are resident in memory right now
+ */
+size_t mem_arena_resident(mem_arena_t *a)
+{
+    size_t pages = (a->commit_brk - a->start_brk) / mem_pagesize();
+
+    return mem_incore(a, a->start_brk, pages) + 
+	mem_incore_regions(a, a->regions);
+}
+
+/*
+ * mem_incore_regions - bytes of the regions in the subtree r in memory
+ */
+static size_t mem_incore_regions(mem_arena_t *a, mem_region_t *r)
+{
+    if (r == NULL)
+	return 0;
+    return mem_incore(a, r->start, r->size / mem_pagesize()) + 
+	mem_incore_regions(a, r->left) + mem_incore_regions(a, r->right);
+}
+
+/*
+ * mem_incore - bytes of the pages [start, start + pages) in memory
+ */
+static size_t mem_incore(mem_arena_t *a, char *start, size_t pages)
 {
-    return (void *)mem_start_brk;
+    size_t i, n = 0;
+
+    if (pages == 0)
+	return 0;
+    if (pages > a->incore_pages) {
+	a->incore = (unsigned char *)realloc(a->incore, pages);
+	if (a->incore == NULL) {
+	    fprintf(stderr, "mem_incore: realloc error\n");
+	    exit(1);
+	}
+	a->incore_pages = pages;
+    }
+    if (mincore(start, pages * mem_pagesize(), a->incore) < 0)
+	return pages * mem_pagesize(); /* assume the worst */
+
+    for (i = 0; i < pages; i++)
+	n += a->incore[i] & 1;
+    return n * mem_pagesize();
 }
 
 /* 
- * mem_heap_hi - return address of last heap byte
+ * mem_update_peak - record a new peak footprint
  */
-void *mem_heap_hi()
+static void mem_update_peak(mem_arena_t *a)
 {
-    return (void *)(mem_brk - 1);
+    size_t bytes = mem_arena_heapsize(a) + a->region_bytes;
+
+    if (bytes > a->peak_bytes) {
+	a->peak_bytes = bytes;
+	a->peak_region_bytes = a->region_bytes;
+    }
 }
 
 /*
- * mem_heapsize() - returns the heap size in bytes
+ * mem_log_sbrk - append an sbrk event to the log
  */
-size_t mem_heapsize() 
+static void mem_log_sbrk(mem_arena_t *a, intptr_t incr)
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    if (a->nevents == a->maxevents) {
+	a->maxevents = a->maxevents ? 2 * a->maxevents : 1024;
+	a->events = (mem_sbrk_event_t *)realloc(a->events, 
+				a->maxevents * sizeof(mem_sbrk_event_t));
+	if (a->events == NULL) {
+	    fprintf(stderr, "mem_log_sbrk: realloc error\n");
+	    exit(1);
+	}
+    }
+    a->events[a->nevents].incr = incr;
+    a->events[a->nevents].heapsize = mem_arena_heapsize(a);
+    a->nevents++;
+}
+
+/*
+ * mem_unmap_all - release every mapped region
+ */
+static void mem_unmap_all(mem_arena_t *a)
+{
+    while (a->regions != NULL)
+	mem_arena_unmap(a, a->regions->start);
+}
+
+/*
+ * AN: The tree of regions, an AVL tree as the size tree in mm.c
+ */
+#define REGION_HEIGHT(r) ((r) ? (r)->height : 0)
+
+static void region_update(mem_region_t *r)
+{
+    int hl = REGION_HEIGHT(r->left);
+    int hr = REGION_HEIGHT(r->right);
+
+    r->height = ((hl > hr) ? hl : hr) + 1;
+}
+
+static mem_region_t *region_rotate_right(mem_region_t *r)
+{
+    mem_region_t *l = r->left;
+
+    r->left = l->right;
+    l->right = r;
+    region_update(r);
+    region_update(l);
+    return l;
+}
+
+static mem_region_t *region_rotate_left(mem_region_t *r)
+{
+    mem_region_t *rr = r->right;
+
+    r->right = rr->left;
+    rr->left = r;
+    region_update(r);
+    region_update(rr);
+    return rr;
+}
+
+/* restore the AVL property at r after one of its subtrees changed */
+static mem_region_t *region_balance(mem_region_t *r)
+{
+    int hl = REGION_HEIGHT(r->left);
+    int hr = REGION_HEIGHT(r->right);
+
+    if (hl > hr + 1) {
+	if (REGION_HEIGHT(r->left->left) < REGION_HEIGHT(r->left->right))
+	    r->left = region_rotate_left(r->left);
+	return region_rotate_right(r);
+    }
+    if (hr > hl + 1) {
+	if (REGION_HEIGHT(r->right->right) < REGION_HEIGHT(r->right->left))
+	    r->right = region_rotate_right(r->right);
+	return region_rotate_left(r);
+    }
+    region_update(r);
+    return r;
+}
+
+static mem_region_t *region_insert(mem_region_t *root, mem_region_t *r)
+{
+    if (root == NULL)
+	return r;
+    if (r->start < root->start)
+	root->left = region_insert(root->left, r);
+    else
+	root->right = region_insert(root->right, r);
+    return region_balance(root);
+}
+
+/* unlink the leftmost region of the subtree at root into *minp */
+static mem_region_t *region_remove_min(mem_region_t *root, mem_region_t **minp)
+{
+    if (root->left == NULL) {
+	*minp = root;
+	return root->right;
+    }
+    root->left = region_remove_min(root->left, minp);
+    return region_balance(root);
+}
+
+/* unlink the region starting at start, if any, into *hitp */
+static mem_region_t *region_remove(mem_region_t *root, char *start, 
+				   mem_region_t **hitp)
+{
+    mem_region_t *succ, *right;
+
+    if (root == NULL)
+	return NULL;
+    if (start < root->start) {
+	root->left = region_remove(root->left, start, hitp);
+	return region_balance(root);
+    }
+    if (start > root->start) {
+	root->right = region_remove(root->right, start, hitp);
+	return region_balance(root);
+    }
+
+    *hitp = root;
+    if (root->left == NULL)
+	return root->right;
+    if (root->right == NULL)
+	return root->left;
+    right = region_remove_min(root->right, &succ);
+    succ->left = root->left;
+    succ->right = right;
+    return region_balance(succ);
+}
+
+/* the region that contains addr, or NULL */
+static mem_region_t *region_find(mem_region_t *root, char *addr)
+{
+    mem_region_t *pred = NULL;
+
+    /* the last region starting at or before addr is the only candidate */
+    while (root != NULL) {
+	if (root->start <= addr) {
+	    pred = root;
+	    root = root->right;
+	}
+	else
+	    root = root->left;
+    }
+    if ((pred != NULL) && (addr < pred->start + pred->size))
+	return pred;
+    return NULL;
+}
+
+/*
+ * mem_arena_pages - AN: the MEM_PAGES_xxx backing an arena actually got
+ */
+int mem_arena_pages(mem_arena_t *a)
+{
+    return a->pages;
+}
+
+/*
+ * mem_arena_use - AN: make a the arena behind the single heap interface;
+ *    returns the one it replaces
+ */
+mem_arena_t *mem_arena_use(mem_arena_t *a)
+{
+    mem_arena_t *old = mem_default;
+
+    mem_default = a;
+    return old;
+}
+
+/*
+ * mem_arena_lo - return address of the first heap byte
+ */
+void *mem_arena_lo(mem_arena_t *a)
+{
+    return (void *)a->start_brk;
+}
+
+/* 
+ * mem_arena_hi - return address of last heap byte
+ */
+void *mem_arena_hi(mem_arena_t *a)
+{
+    return (void *)(a->brk - 1);
+}
+
+/*
+ * mem_arena_maxsize - AN: bytes reserved for the heap. The heap never 
+ *    leaves [mem_arena_lo, mem_arena_lo + mem_arena_maxsize), and no 
+ *    region is ever mapped inside that range.
+ */
+size_t mem_arena_maxsize(mem_arena_t *a)
+{
+    return a->max_heap;
+}
+
+/*
+ * mem_arena_heapsize() - returns the heap size in bytes
+ */
+size_t mem_arena_heapsize(mem_arena_t *a) 
+{
+    return (size_t)(a->brk - a->start_brk);
 }
 
 /*
@@ -99,3 +791,101 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * AN: the single heap interface, on the default arena
+ */
+void mem_reset_brk()
+{
+    mem_arena_reset_brk(mem_default);
+}
+
+void *mem_sbrk(int incr)
+{
+    return mem_arena_sbrk(mem_default, incr);
+}
+
+void *mem_heap_lo()
+{
+    return mem_arena_lo(mem_default);
+}
+
+void *mem_heap_hi()
+{
+    return mem_arena_hi(mem_default);
+}
+
+size_t mem_heapsize()
+{
+    return mem_arena_heapsize(mem_default);
+}
+
+void *mem_map(size_t size)
+{
+    return mem_arena_map(mem_default, size);
+}
+
+void *mem_remap(void *start, size_t size)
+{
+    return mem_arena_remap(mem_default, start, size);
+}
+
+void mem_unmap(void *start)
+{
+    mem_arena_unmap(mem_default, start);
+}
+
+int mem_is_mapped(void *lo, void *hi)
+{
+    return mem_arena_is_mapped(mem_default, lo, hi);
+}
+
+size_t mem_footprint()
+{
+    return mem_arena_footprint(mem_default);
+}
+
+size_t mem_peak_footprint()
+{
+    return mem_arena_peak_footprint(mem_default);
+}
+
+size_t mem_peak_regions()
+{
+    return mem_arena_peak_regions(mem_default);
+}
+
+size_t mem_sbrk_events(const mem_sbrk_event_t **events)
+{
+    return mem_arena_sbrk_events(mem_default, events);
+}
+
+void mem_release(void *lo, void *hi)
+{
+    mem_arena_release(mem_default, lo, hi);
+}
+
+void mem_reclaim(void *lo, void *hi)
+{
+    mem_arena_reclaim(mem_default, lo, hi);
+}
+
+void mem_release_heap()
+{
+    mem_arena_release_heap(mem_default);
+}
+
+size_t mem_released()
+{
+    return mem_arena_released(mem_default);
+}
+
+size_t mem_committed()
+{
+    return mem_arena_committed(mem_default);
+}
+
+size_t mem_resident()
+{
+    return mem_arena_resident(mem_default);
+}
@@ -1,11 +1,73 @@
 #include <unistd.h>
+#include <stdint.h>
 
-void mem_init(void);               
+void mem_init(void);
+void mem_set_max_heap(size_t size);
 void mem_deinit(void);
 void *mem_sbrk(int incr);
-void mem_reset_brk(void); 
+void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
 
+/* AN: regions mapped outside the heap, and the peak footprint */
+void *mem_map(size_t size);
+void *mem_remap(void *start, size_t size);
+void mem_unmap(void *start);
+int mem_is_mapped(void *lo, void *hi);
+size_t mem_footprint(void);
+size_t mem_peak_footprint(void);
+size_t mem_peak_regions(void);
+
+/* AN: log of sbrk events, for the growth policy in mm.c */
+typedef struct {
+    intptr_t incr;              /* bytes added (> 0) or given back (< 0) */
+    size_t heapsize;            /* heap size after the event */
+} mem_sbrk_event_t;
+
+size_t mem_sbrk_events(const mem_sbrk_event_t **events);
+
+/* AN: releasing free pages, and the resident set */
+void mem_release(void *lo, void *hi);
+void mem_reclaim(void *lo, void *hi);
+void mem_release_heap(void);
+size_t mem_released(void);
+size_t mem_committed(void);
+size_t mem_resident(void);
+
+/* AN: independent memory systems; the calls above use the default one */
+
+/* AN: page backing of an arena's heap */
+#define MEM_PAGES_NORMAL 0      /* base pages */
+#define MEM_PAGES_THP 1         /* 2 MB aligned, madvise(MADV_HUGEPAGE) */
+#define MEM_PAGES_HUGETLB 2     /* MAP_HUGETLB, else THP */
+
+typedef struct mem_arena_t mem_arena_t;
+
+mem_arena_t *mem_arena_default(void);
+mem_arena_t *mem_arena_create(size_t max_heap);
+mem_arena_t *mem_arena_create_pages(size_t max_heap, int pages);
+int mem_arena_pages(mem_arena_t *a);
+mem_arena_t *mem_arena_use(mem_arena_t *a);
+void mem_arena_destroy(mem_arena_t *a);
+void *mem_arena_sbrk(mem_arena_t *a, intptr_t incr);
+void mem_arena_reset_brk(mem_arena_t *a);
+void *mem_arena_lo(mem_arena_t *a);
+void *mem_arena_hi(mem_arena_t *a);
+size_t mem_arena_heapsize(mem_arena_t *a);
+size_t mem_arena_maxsize(mem_arena_t *a);
+void *mem_arena_map(mem_arena_t *a, size_t size);
+void *mem_arena_remap(mem_arena_t *a, void *start, size_t size);
+void mem_arena_unmap(mem_arena_t *a, void *start);
+int mem_arena_is_mapped(mem_arena_t *a, void *lo, void *hi);
+size_t mem_arena_footprint(mem_arena_t *a);
+size_t mem_arena_peak_footprint(mem_arena_t *a);
+size_t mem_arena_peak_regions(mem_arena_t *a);
+size_t mem_arena_sbrk_events(mem_arena_t *a, const mem_sbrk_event_t **events);
+void mem_arena_release(mem_arena_t *a, void *lo, void *hi);
+void mem_arena_reclaim(mem_arena_t *a, void *lo, void *hi);
+void mem_arena_release_heap(mem_arena_t *a);
+size_t mem_arena_released(mem_arena_t *a);
+size_t mem_arena_committed(mem_arena_t *a);
+size_t mem_arena_resident(mem_arena_t *a);
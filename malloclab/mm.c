@@ -10,6 +10,8 @@
  *
  * Provided with the lab is the memlib module which models a virtual
  * memory of MAX_HEAP ~20MB, allocated by the actual libc malloc service. 
+ * (Now reserved with mmap and committed as it is used; mdriver -m sets
+ * its size.)
  * The mdriver initializes this VM model by calling the mem_init() from 
  * the provided module, and drives all the testing with its main routine.
  * 
@@ -49,15 +51,202 @@
  *
  * ADDON_1: modification to eliminate need for a footer in allocated blox.
  *
+ *
+ * AN: Description of implementation #2: segregated explicit free lists
+ *
+ * The implicit list is kept for coalescing (boundary tags are unchanged),
+ * but free blocks are additionally threaded into one of NUM_CLASSES 
+ * doubly linked lists. The links live in the payload of the free block:
+ * the successor pointer at bp, the predecessor right after it. The
+ * minimum block therefore grows to hdr + 2 ptrs + ftr (MIN_BLKSIZE).
+ *
+ * Size classes are powers of two: class 0 holds blocks up to 16 bytes,
+ * class k holds blocks in (2^(k+3), 2^(k+4)], the last class holds the
+ * rest. Lists are LIFO; first_fit() starts at the class of the request
+ * and only ever touches free blocks.
+ *
+ * ADDON_2: list maintenance. A block is in a list iff it is free. 
+ * coalesce() takes a free block that is not yet listed, unlinks any free
+ * neighbours it absorbs, and lists the result. place() unlinks the block
+ * it allocates from and lists the split remainder. extend_heap() goes
+ * through coalesce(), so new heap space is listed as well.
+ *
+ *
+ * AN: Description of implementation #3: best fit on a balanced tree
+ *
+ * The segregated lists only keep blocks up to LIST_MAXSIZE bytes. Larger
+ * free blocks are indexed by an AVL tree keyed on block size, stored in 
+ * the free blocks themselves (left/right child and height after the list
+ * links). Blocks of equal size share one tree node: the first becomes the
+ * node, the others are chained behind it with the list links, so a node
+ * is recognised by a NULL predecessor. Lookup, insert and delete are
+ * O(log n) in the number of distinct free sizes; deleting a chained block
+ * is O(1).
+ *
+ * ADDON_3: best_fit() looks for the smallest block >= asize: it scans
+ * the list of the request's class, then the first non-empty higher class,
+ * then asks the tree for its smallest size >= asize. mm_malloc uses it
+ * in place of first_fit(), which is gone.
+ *
+ * ADDON_4: mm_realloc works in place where it can. The old size comes
+ * from the block header. Shrinking splits off the tail; growing absorbs
+ * a free next block, extends the heap by the shortfall if the block is
+ * the last one, or slides the payload back into a free previous block
+ * with memmove. Only when none of that fits is the payload copied.
+ *
+ *
+ * AN: Description of implementation #4: per-thread caches
+ *
+ * Everything above is now the central heap (heap_malloc, heap_free, 
+ * heap_realloc), which is not thread safe and runs under heap_lock.
+ * In front of it, every thread owns a small cache (tcache) of free blocks:
+ * one bounded, singly linked LIFO bin per block size up to TCACHE_MAXSIZE.
+ * Cached blocks stay marked allocated in the heap, so the central heap 
+ * never sees them, and the link lives in the first payload word. 
+ *
+ * mm_malloc pops from the bin of its block size, mm_free pushes onto it;
+ * neither touches the lock or any shared line written by other threads.
+ * Only a miss, a full bin, a large block or a realloc take the lock.
+ *
+ * The one word of heap metadata read outside the lock is the header of
+ * a block being freed or resized, read by the thread that owns the 
+ * block. The free or placement of the block in front of it rewrites its
+ * prev-alloc bit under the lock at the same time. Both sides of that
+ * word use relaxed atomic accesses (GET_SHARED, PUT_SHARED); the size 
+ * bits cannot change while the owner holds the block, so nothing 
+ * stronger is needed.
+ *
+ * ADDON_5: mm_init starts a new heap generation. A cache still holding
+ * blocks of an older heap (the driver reinitializes per trace) is dropped
+ * on its next use. A thread's cache is flushed back to the heap when the
+ * thread exits.
+ *
+ * ADDON_6: deferred coalescing (fast bins), off by default and switched 
+ * with mm_set_fastbins(). heap_free parks blocks up to FASTBIN_MAXSIZE in
+ * exact-size LIFO bins, still marked allocated, without touching the
+ * neighbours' boundary tags; heap_malloc reuses them first. defragment()
+ * is the batch coalescer: it really frees up to a budget of parked blocks.
+ * It runs with FASTBIN_BUDGET once FASTBIN_THRESHOLD blocks are parked, 
+ * and drains all bins when a request above FASTBIN_MAXSIZE finds no fit.
+ *
+ * ADDON_7: bitmap-indexed size classes. The power-of-two classes are 
+ * replaced by exact ones, one per DSIZE step: class = asize >> CLASS_SHIFT,
+ * a shift instead of a loop. NUM_CLASSES is 64, so class_map, with bit c
+ * set iff list c is non-empty, fits a single 64-bit word. The lists now 
+ * cover blocks up to LIST_MAXSIZE = 504 bytes. The first non-empty class at
+ * or above a request is found with one __builtin_ctzll, and its head is
+ * both the first and the best fit, so list lookups are O(1) however many 
+ * classes there are.
+ *
+ *
+ * AN: Description of implementation #5: headerless slabs for tiny objects
+ *
+ * Requests up to SLAB_MAXSIZE bytes are served by a slab sub-allocator 
+ * and carry no header. A run is one RUNSIZE page taken from the heap as an
+ * ordinary allocated block whose payload is page aligned. The run 
+ * descriptor sits at the start of that page, followed by equal objects of
+ * one slab class; a bitmap in the descriptor marks the objects in use.
+ * The descriptor of an object is found by masking off the low address
+ * bits (RUN_OF). Partially used runs of a class are on a doubly linked 
+ * list; a run that empties goes back to the heap unless it is the only
+ * run of its class with room.
+ *
+ * ADDON_8: routing. mm_free and mm_realloc tell slab objects from heap
+ * blocks by address: run_map has one bit per heap page, set iff the page
+ * holds a run. heap_init sizes the map for the whole range reserved for
+ * the heap, so the slabs serve tiny objects however large mdriver -m 
+ * makes it. Slab object sizes (<= 64) and the heap block sizes cached by
+ * the tcache (> 64) do not overlap, so both share the thread cache bins.
+ *
+ *
+ * AN: Description of implementation #6: regions for large objects
+ *
+ * Requests of LARGE_MINSIZE bytes and more bypass the heap. Each one gets
+ * its own page-aligned region from memlib (mem_map), outside the sbrk 
+ * heap, with a small large_t header in front of the payload: the links of
+ * a doubly linked list of all live large objects and the mapped size.
+ * Freeing one unmaps the region at once, so its pages go back to the 
+ * system and the heap never holds large holes that it cannot give back.
+ *
+ * ADDON_9: routing. A pointer outside the range reserved for the heap is
+ * a large object. That range is fixed when the arena is made and holds 
+ * no region, so the test needs no lock, unlike one against the break,
+ * which other threads move. mm_realloc keeps a large object in its 
+ * region while it fits and otherwise resizes the region with mem_remap,
+ * which may move it without copying; a heap block that grows past 
+ * LARGE_MINSIZE moves into a region, a large object that shrinks below
+ * it moves into the heap.
+ *
+ * ADDON_10: heap trimming. mem_sbrk now takes negative increments. When
+ * freeing leaves a free block of TRIM_THRESHOLD bytes or more in front of
+ * the epilogue, free_block cuts it down to TRIM_KEEP bytes and gives the 
+ * rest back to memlib, so the heap follows the live data down again 
+ * after a peak. The gap between the two sizes keeps a workload that 
+ * allocates and frees around the top from trimming and growing each time.
+ *
+ * ADDON_11: growth policy. On a miss, grow_heap() counts a free block in
+ * front of the epilogue towards the request and extends the heap by the
+ * rest only, and the caller places just asize in the result. The amount
+ * extended is at least grow_chunk, which starts at CHUNKSIZE, doubles 
+ * (up to GROW_MAXCHUNK, and to no more than 1/GROW_RATIO of the heap)
+ * when the heap had to grow again within GROW_WINDOW heap allocations, 
+ * and halves back for every GROW_WINDOW allocations without growth. 
+ * memlib keeps a log of the sbrk events.
+ *
+ *
+ * AN: Description of implementation #7: allocator instances on arenas
+ *
+ * memlib now models any number of independent memory systems (arenas),
+ * and all of the allocator's state - heap pointers, lock, free lists and
+ * tree, fast bins, slab runs, large objects, growth policy - lives in an
+ * mm_heap_t bound to one arena. Every routine takes the instance it works
+ * on as its first argument. mm_malloc and friends pass heap_default, the
+ * instance on memlib's default arena; mm_heap_malloc, mm_heap_free and
+ * mm_heap_realloc pass one made by mm_heap_create. Each instance has its
+ * own thread caches, found through its own thread-specific data key.
+ *
+ * ADDON_12: page release. A free block of RELEASE_MINSIZE bytes or more
+ * left by free_block hands the whole pages between its free block fields
+ * (links, tree children and height) and its footer back to the system 
+ * with mem_arena_release. The heap keeps its size, but those pages stop 
+ * counting against the resident set until the block is used again. A 
+ * third tag bit marks a released block. When one leaves its free list, 
+ * to be used, merged or resized, remove_free takes its pages out of the
+ * released count again (mem_arena_reclaim), and any rewrite of the tags
+ * drops the mark. free_block releases a merged block as a whole and place
+ * a split remainder again; madvise is cheap on pages not in memory.
+ *
+ * ADDON_13: 64-bit builds. Block sizes are multiples of ALIGNMENT, which
+ * config.h sets to 16 on LP64 (8 with -m32), so payloads are 16 byte 
+ * aligned. Headers and footers stay 4 bytes: the minimum block only grows
+ * from 24 to 32 bytes. The padding in front of the prologue already puts
+ * the first payload 16 bytes into the page. The slab classes shrink to the
+ * multiples of 16. The fast bins, the tcache bins and the size classes 
+ * step by ALIGNMENT, since no block size falls between two multiples of
+ * it, so the same 64 classes reach twice as far: the lists cover blocks
+ * up to 1008 bytes on LP64.
+ *
+ * ADDON_14: compressed links. The list links and tree children of a free
+ * block, and the links of parked and cached blocks, are 4 byte offsets 
+ * from heap_base (the start of the arena) when USE_COMPRESSED_LINKS is 
+ * set, which is the default on 64-bit. A free block then needs only 16 
+ * bytes, as in the 32-bit build, at the price of an add on every link 
+ * followed and a subtract on every link stored. Heaps are limited to 4 GB,
+ * which extend_heap enforces. The accessors (get_link, put_link and the
+ * NEXT_FREEP family) take the heap base as an argument, so every list 
+ * and tree operation says which instance's heap it works in.
+ *
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 /* macros for memory management. */
 #include "mm_macros.c"
@@ -80,63 +269,530 @@ team_t team = {
 };
 
 /* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
+/* AN: ALIGNMENT now comes from config.h, shared with the driver */
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
+// #define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
 
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
-/* always points at prologue block of heap */
-static void *heap_listp; // = mem_heap_lo();
-static void *rover;
+
+/* ADDON_5: the central heap lock and the per-thread caches */
+#define TCACHE_MAXSIZE 128                     /* largest cached block size */
+#define TCACHE_BINS (TCACHE_MAXSIZE/ALIGNMENT + 1) /* one bin per block size */
+#define TCACHE_COUNT 7                         /* blocks per bin */
+
+/* AN: a thread's cache in front of one instance; the thread finds it
+ * under the instance's tcache_key */
+typedef struct tcache_t {
+	mm_heap_t *heap;                     /* instance of the cached blocks */
+	struct tcache_t *next;               /* the other caches of that heap */
+	struct tcache_t *prev;
+	unsigned int gen;                    /* heap generation of the entries */
+	unsigned int count[TCACHE_BINS];     /* blocks in each bin */
+	char *head[TCACHE_BINS];             /* first block of each bin */
+} tcache_t;
+
+/* ADDON_6: fast bins for deferred coalescing */
+#define FASTBIN_MAXSIZE 256                       /* largest parked block size */
+#define FASTBIN_BINS (FASTBIN_MAXSIZE/ALIGNMENT + 1)  /* one bin per block size */
+#define FASTBIN_THRESHOLD 512                     /* parked blocks before a pass */
+#define FASTBIN_BUDGET 128                        /* blocks freed per pass */
+
+
+/* ADDON_8: slab runs for tiny objects */
+#define RUNSIZE 4096                          /* bytes per run, a power of 2 */
+#define RUN_MAPWORDS (RUNSIZE / DSIZE / 64)   /* enough bits for 8-byte objects */
+#define SLAB_MAXSIZE 64                       /* largest slab object */
+#if ALIGNMENT == 16
+#define SLAB_CLASSES 4                        /* ADDON_13: see slab_sizes */
+#else
+#define SLAB_CLASSES 6
+#endif
+
+/* the run a slab object lives in */
+#define RUN_OF(p) ((run_t *)((unsigned long)(p) & ~(unsigned long)(RUNSIZE - 1)))
+
+typedef struct run_t {
+	struct run_t *next;                     /* next run with room, same class */
+	struct run_t *prev;                     /* previous run with room */
+	unsigned int objsize;                   /* object size of this run */
+	unsigned int nobjs;                     /* objects in this run */
+	unsigned int nfree;                     /* objects not in use */
+	unsigned int first;                     /* offset of the first object */
+	unsigned long long map[RUN_MAPWORDS];   /* bit set = in use (or absent) */
+} run_t;
+
+/* object sizes, and the class of a request of n bytes at [(n-1)/DSIZE] 
+ * ADDON_13: objects are aligned like any payload, so a 16 byte ALIGNMENT
+ * leaves only its multiples */
+#if ALIGNMENT == 16
+static const unsigned int slab_sizes[SLAB_CLASSES] = {16, 32, 48, 64};
+static const unsigned char slab_class[SLAB_MAXSIZE / DSIZE] = {0, 0, 1, 1, 2, 2, 3, 3};
+#else
+static const unsigned int slab_sizes[SLAB_CLASSES] = {8, 16, 24, 32, 48, 64};
+static const unsigned char slab_class[SLAB_MAXSIZE / DSIZE] = {0, 1, 2, 3, 4, 4, 5, 5};
+#endif
+
+
+/* ADDON_9: large objects in regions of their own */
+#define LARGE_MINSIZE (4*CHUNKSIZE) /* smallest request sent to a region */
+
+typedef struct large_t {
+	struct large_t *next;
+	struct large_t *prev;
+	size_t size;                    /* mapped bytes */
+} large_t;
+
+#define LARGE_HDRSIZE (ALIGN(sizeof(large_t)))
+#define LARGE_OF(p) ((large_t *)((char *)(p) - LARGE_HDRSIZE))
+
+
+/* ADDON_10: heap trimming */
+#define TRIM_THRESHOLD (8*CHUNKSIZE) /* top free block that gets trimmed */
+#define TRIM_KEEP CHUNKSIZE          /* bytes of it that stay in the heap */
+
+/* ADDON_12: page release */
+#define RELEASE_MINSIZE (64*CHUNKSIZE) /* free block whose pages go back */
+#define RELEASE_OFFSET (5*LINKSIZE)    /* free block fields, kept resident */
+
+/* ADDON_11: growth policy */
+#define GROW_MAXCHUNK (4*CHUNKSIZE) /* largest growth step */
+#define GROW_WINDOW 64              /* heap allocations per growth phase */
+#define GROW_RATIO 8                /* heap size per growth step, at least */
+
+
+/* ADDON_2: heads of the segregated free lists, one per size class */
+/* ADDON_3: lists cover sizes up to LIST_MAXSIZE, the tree the rest */
+/* ADDON_7: one exact class per DSIZE step, indexed by a one-word bitmap */
+/* ADDON_13: per ALIGNMENT step; every block size is a multiple of it */
+#define NUM_CLASSES 64
+#if ALIGNMENT == 16
+#define CLASS_SHIFT 4 /* log2(ALIGNMENT) */
+#else
+#define CLASS_SHIFT 3
+#endif
+#define LIST_MAXSIZE ((NUM_CLASSES - 1) << CLASS_SHIFT)
+#define SIZE_CLASS(asize) ((int)((asize) >> CLASS_SHIFT))
+
+/* AN: the state of one allocator instance (see implementation #7) */
+struct mm_heap_t {
+	mem_arena_t *arena;                  /* memlib arena the heap lives in */
+	pthread_mutex_t heap_lock;           /* ADDON_5: the central heap lock */
+	unsigned int heap_gen;               /* ADDON_5: bumped by each init */
+	pthread_key_t tcache_key;            /* ADDON_5: each thread's cache */
+	tcache_t *tcaches;                   /* ADDON_5: all of them */
+
+	/* always points at prologue block of heap */
+	void *heap_listp; // = mem_heap_lo();
+	void *rover;
+	char *heap_base;                     /* ADDON_14: origin of link offsets */
+	char *heap_end;                      /* ADDON_9: end of the reserved range */
+
+	/* ADDON_2/ADDON_3: free lists and size tree */
+	char *seg_lists[NUM_CLASSES];
+	unsigned long long class_map;
+	char *tree_root;
+
+	/* ADDON_6: fast bins */
+	int fastbins_on;
+	size_t fast_count;
+	char *fastbins[FASTBIN_BINS];
+
+	/* ADDON_8: slab runs */
+	run_t *slab_runs[SLAB_CLASSES];      /* runs with room, per class */
+	unsigned long run_base;              /* page containing the heap start */
+	unsigned long run_pages;             /* heap pages covered by run_map */
+	unsigned char *run_map;              /* one bit per page, in a malloc'd map */
+
+	/* ADDON_9: large objects */
+	large_t *large_list;
+
+	/* ADDON_11: growth policy */
+	size_t grow_chunk;                   /* current growth step */
+	unsigned long grow_calls;            /* heap allocations so far */
+	unsigned long grow_last;             /* grow_calls at the last growth */
+};
+
+/* the instance behind mm_init/mm_malloc/mm_free/mm_realloc */
+static mm_heap_t heap_default = { .heap_lock = PTHREAD_MUTEX_INITIALIZER };
+static pthread_once_t heap_default_once = PTHREAD_ONCE_INIT;
 
 /* declare helper fcns */
-static void *extend_heap (size_t words);
-static void *coalesce(void *bp);
-static void defragment(void);
-static void *first_fit(size_t asize);
-static void *best_fit(size_t asize);
-static void *next_fit(size_t asize);
-static void place(void *bp, size_t asize);
-static int mm_check(void);
+static int heap_init(mm_heap_t *h);
+static void *extend_heap (mm_heap_t *h, size_t words);
+static void *grow_heap(mm_heap_t *h, size_t asize);
+static void *coalesce(mm_heap_t *h, void *bp);
+static void trim_heap(mm_heap_t *h, void *bp);
+static void release_block(mm_heap_t *h, void *bp);
+static void reclaim_block(mm_heap_t *h, void *bp);
+static void defragment(mm_heap_t *h, size_t budget);
+static void *best_fit(mm_heap_t *h, size_t asize);
+static void *next_fit(mm_heap_t *h, size_t asize);
+static void place(mm_heap_t *h, void *bp, size_t asize);
+static void realloc_place(mm_heap_t *h, void *bp, size_t total, size_t asize);
+static int mm_check(mm_heap_t *h);
+
+/* ADDON_5: central heap and thread cache */
+static void *heap_malloc(mm_heap_t *h, size_t size);
+static void heap_free(mm_heap_t *h, void *ptr);
+static void free_block(mm_heap_t *h, void *ptr);
+static void *heap_realloc(mm_heap_t *h, void *ptr, size_t size);
+static void *tcache_get(mm_heap_t *h, size_t asize);
+static int tcache_put(mm_heap_t *h, void *bp, size_t asize);
+static void tcache_flush(void *arg);
+static void heap_default_key(void);
+
+/* ADDON_8: slab helpers */
+static void *heap_alloc_aligned(mm_heap_t *h, size_t align, size_t asize);
+static int slab_owns(mm_heap_t *h, void *ptr);
+static void *slab_alloc(mm_heap_t *h, int c);
+static void slab_free(mm_heap_t *h, void *ptr);
+
+/* ADDON_9: large object helpers */
+static int large_owns(mm_heap_t *h, void *ptr);
+static void *large_alloc(mm_heap_t *h, size_t size);
+static void large_free(mm_heap_t *h, void *ptr);
+static void *large_realloc(mm_heap_t *h, void *ptr, size_t size);
+
+/* ADDON_2: free list helpers */
+static char *list_fit(mm_heap_t *h, size_t asize);
+static void insert_free(mm_heap_t *h, void *bp);
+static void remove_free(mm_heap_t *h, void *bp);
+
+/* ADDON_3: size tree helpers */
+static char *tree_insert(char *base, char *n, char *bp);
+static char *tree_remove(char *base, char *n, char *bp);
+static char *tree_search(mm_heap_t *h, size_t asize);
+static int tree_check(char *base, char *n, size_t lo, size_t hi, int *count);
 
 
 
 /* 
  * mm_init - initialize the malloc package.
+ * AN: that is, the default instance, on the default memlib arena.
  */
 int mm_init(void)
 {
+	pthread_once(&heap_default_once, heap_default_key);
+	heap_default.arena = mem_arena_default();
+	return heap_init(&heap_default);
+}
+
+/*
+ * mm_malloc, mm_free, mm_realloc, mm_set_fastbins - AN: the original 
+ *     interface, on the default instance
+ */
+void *mm_malloc(size_t size)
+{
+	return mm_heap_malloc(&heap_default, size);
+}
+
+void mm_free(void *ptr)
+{
+	mm_heap_free(&heap_default, ptr);
+}
+
+void *mm_realloc(void *ptr, size_t size)
+{
+	return mm_heap_realloc(&heap_default, ptr, size);
+}
+
+void mm_set_fastbins(int on)
+{
+	mm_heap_set_fastbins(&heap_default, on);
+}
+
+/*
+ * mm_path_limits - AN: the largest request of each path of mm_malloc but
+ *     the last. A block of ADJUST_SIZE(size) fits the lists up to 
+ *     LIST_MAXSIZE, which is a multiple of ALIGNMENT.
+ */
+void mm_path_limits(size_t limits[MM_PATHS - 1])
+{
+	limits[0] = SLAB_MAXSIZE;
+	limits[1] = LIST_MAXSIZE - WSIZE;
+	limits[2] = LARGE_MINSIZE - 1;
+}
+
+/*
+ * mm_heap_create - AN: a new allocator instance on its own, empty arena.
+ *     Returns NULL if the arena cannot hold the initial heap.
+ */
+mm_heap_t *mm_heap_create(mem_arena_t *arena)
+{
+	mm_heap_t *h;
+
+	if ((h = (mm_heap_t *)calloc(1, sizeof(mm_heap_t))) == NULL)
+		return NULL;
+	if (pthread_key_create(&h->tcache_key, tcache_flush) != 0) {
+		free(h);
+		return NULL;
+	}
+	pthread_mutex_init(&h->heap_lock, NULL);
+	h->arena = arena;
+
+	if (heap_init(h) < 0) {
+		mm_heap_destroy(h);
+		return NULL;
+	}
+	return h;
+}
+
+/*
+ * mm_heap_destroy - AN: drop an instance. Its blocks go with it, and so
+ *     do the thread caches in front of it; no thread may use it any more.
+ *     The arena is the caller's to reset or destroy.
+ */
+void mm_heap_destroy(mm_heap_t *h)
+{
+	tcache_t *tc;
+
+	pthread_key_delete(h->tcache_key);
+	while ((tc = h->tcaches) != NULL) {
+		h->tcaches = tc->next;
+		free(tc);
+	}
+	pthread_mutex_destroy(&h->heap_lock);
+	free(h->run_map);
+	free(h);
+}
+
+/* 
+ * mm_heap_malloc - 
+ * ADDON_5: serve small blocks from the thread cache, otherwise allocate
+ *     from the central heap under the lock.
+ * AN: on instance h; mm_malloc is this on the default instance.
+ */
+void *mm_heap_malloc(mm_heap_t *h, size_t size)
+{
+	void *bp;
+	int c;
+
+	if (size == 0)
+		return NULL;
+
+	/* ADDON_8: tiny objects come from a slab, or the heap if no run is left */
+	if (size <= SLAB_MAXSIZE) {
+		c = slab_class[(size - 1) / DSIZE];
+		if ((bp = tcache_get(h, slab_sizes[c])) != NULL)
+			return bp;
+
+		pthread_mutex_lock(&h->heap_lock);
+		if ((bp = slab_alloc(h, c)) == NULL)
+			bp = heap_malloc(h, size);
+		pthread_mutex_unlock(&h->heap_lock);
+		return bp;
+	}
+
+	/* ADDON_9: large objects get a region of their own */
+	if (size >= LARGE_MINSIZE) {
+		pthread_mutex_lock(&h->heap_lock);
+		bp = large_alloc(h, size);
+		pthread_mutex_unlock(&h->heap_lock);
+		return bp;
+	}
+
+	if ((bp = tcache_get(h, ADJUST_SIZE(size))) != NULL)
+		return bp;
+
+	pthread_mutex_lock(&h->heap_lock);
+	bp = heap_malloc(h, size);
+	pthread_mutex_unlock(&h->heap_lock);
+	return bp;
+}
+
+/*
+ * mm_heap_free - 
+ * ADDON_5: keep small blocks in the thread cache while there is room,
+ *     otherwise free them to the central heap under the lock.
+ * AN: a block must be freed through the instance it came from.
+ */
+void mm_heap_free(mm_heap_t *h, void *ptr)
+{
+	size_t size;
+
+	if (ptr == NULL)
+		return;
+
+	/* ADDON_8: slab objects have no header; their run knows the size */
+	if (slab_owns(h, ptr)) {
+		if (tcache_put(h, ptr, RUN_OF(ptr)->objsize))
+			return;
+
+		pthread_mutex_lock(&h->heap_lock);
+		slab_free(h, ptr);
+		pthread_mutex_unlock(&h->heap_lock);
+		return;
+	}
+
+	/* ADDON_9: a large object gives its region back */
+	if (large_owns(h, ptr)) {
+		pthread_mutex_lock(&h->heap_lock);
+		large_free(h, ptr);
+		pthread_mutex_unlock(&h->heap_lock);
+		return;
+	}
+
+	/* ADDON_8: small heap blocks (slab fallback) must not mix with slab 
+	 * objects in the tcache bins */
+	size = GET_SIZE_SHARED(HDRP(ptr));
+	if ((size > SLAB_MAXSIZE) && tcache_put(h, ptr, size))
+		return;
+
+	pthread_mutex_lock(&h->heap_lock);
+	heap_free(h, ptr);
+	pthread_mutex_unlock(&h->heap_lock);
+}
+
+/*
+ * mm_heap_set_fastbins - 
+ * ADDON_6: turn deferred coalescing on or off. Turning it off releases
+ *     whatever is still parked in the fast bins.
+ */
+void mm_heap_set_fastbins(mm_heap_t *h, int on)
+{
+	pthread_mutex_lock(&h->heap_lock);
+	h->fastbins_on = on;
+	if (!on)
+		defragment(h, h->fast_count);
+	pthread_mutex_unlock(&h->heap_lock);
+}
+
+/*
+ * mm_heap_realloc - 
+ * ADDON_5: always resized by the central heap, under the lock.
+ * AN: like mm_heap_free, through the instance the block came from.
+ */
+void *mm_heap_realloc(mm_heap_t *h, void *ptr, size_t size)
+{
+	void *newptr;
+
+	if (ptr == NULL)
+		return mm_heap_malloc(h, size);
+
+	if (size == 0) {
+		mm_heap_free(h, ptr);
+		return NULL;
+	}
+
+	/* ADDON_8: a slab object stays put while it fits, else it moves */
+	if (slab_owns(h, ptr)) {
+		if (size <= RUN_OF(ptr)->objsize)
+			return ptr;
+		if ((newptr = mm_heap_malloc(h, size)) == NULL)
+			return NULL;
+		memcpy(newptr, ptr, RUN_OF(ptr)->objsize);
+		mm_heap_free(h, ptr);
+		return newptr;
+	}
+
+	/* ADDON_9: large objects stay in a region while they are large */
+	if (large_owns(h, ptr)) {
+		if (size >= LARGE_MINSIZE) {
+			pthread_mutex_lock(&h->heap_lock);
+			newptr = large_realloc(h, ptr, size);
+			pthread_mutex_unlock(&h->heap_lock);
+			return newptr;
+		}
+		if ((newptr = mm_heap_malloc(h, size)) == NULL)
+			return NULL;
+		memcpy(newptr, ptr, size);
+		mm_heap_free(h, ptr);
+		return newptr;
+	}
+
+	/* ADDON_9: a heap block growing into a large object moves out */
+	if (size >= LARGE_MINSIZE) {
+		if ((newptr = mm_heap_malloc(h, size)) == NULL)
+			return NULL;
+		memcpy(newptr, ptr, MIN(GET_SIZE_SHARED(HDRP(ptr)) - WSIZE, size));
+		mm_heap_free(h, ptr);
+		return newptr;
+	}
+
+	pthread_mutex_lock(&h->heap_lock);
+	newptr = heap_realloc(h, ptr, size);
+	pthread_mutex_unlock(&h->heap_lock);
+	return newptr;
+}
+
+/*
+ * heap_init - AN: was mm_init; initializes instance h on its arena.
+ */
+static int heap_init(mm_heap_t *h)
+{
+	unsigned long pages;
 
 	/* first implementation */
 	/* initial empty heap */
-	if ( (heap_listp = mem_sbrk(2*DSIZE))== (void *)-1)
+	if ( (h->heap_listp = mem_arena_sbrk(h->arena, 2*DSIZE))== (void *)-1)
 		return -1;
 
+	/* ADDON_14: compressed links count from the start of the arena */
+	h->heap_base = mem_arena_lo(h->arena);
+	h->heap_end = h->heap_base + mem_arena_maxsize(h->arena);
+
 	/* alignment padding; prologue hdr; prologue ftr; epilogue hdr */
-	PUT(heap_listp, 0);
-	PUT(heap_listp + (1*WSIZE), PACK(DSIZE, 1+2));
-	PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1+2));
-	PUT(heap_listp + (3*WSIZE), PACK(0, 1+2));
-	heap_listp+=(2*WSIZE); // points right after prologue block?
+	PUT(h->heap_listp, 0);
+	PUT(h->heap_listp + (1*WSIZE), PACK(DSIZE, 1+2));
+	PUT(h->heap_listp + (2*WSIZE), PACK(DSIZE, 1+2));
+	PUT(h->heap_listp + (3*WSIZE), PACK(0, 1+2));
+	h->heap_listp+=(2*WSIZE); // points right after prologue block?
 
 	/* ADDON_0: initial next fit search starts at beginning */
-	rover = heap_listp;
+	h->rover = h->heap_listp;
+
+	/* ADDON_2: all free lists start out empty */
+	memset(h->seg_lists, 0, sizeof(h->seg_lists));
+	h->class_map = 0;
+	h->tree_root = NULL;
+
+	/* ADDON_6: so do the fast bins */
+	memset(h->fastbins, 0, sizeof(h->fastbins));
+	h->fast_count = 0;
+
+	/* ADDON_8: and there are no slab runs */
+	memset(h->slab_runs, 0, sizeof(h->slab_runs));
+	h->run_base = (unsigned long)mem_arena_lo(h->arena) & ~(unsigned long)(RUNSIZE - 1);
+	pages = ((unsigned long)h->heap_end - h->run_base) / RUNSIZE + 1;
+	if (pages > h->run_pages) {
+		free(h->run_map);
+		if ((h->run_map = malloc(pages / 8 + 1)) == NULL) {
+			h->run_pages = 0;
+			return -1;
+		}
+		h->run_pages = pages;
+	}
+	memset(h->run_map, 0, h->run_pages / 8 + 1);
+
+	/* ADDON_9: the regions of the previous heap went with mem_reset_brk */
+	h->large_list = NULL;
+
+	/* ADDON_11: growth starts over with single chunks, and the first
+	 * growth does not count as sustained */
+	h->grow_chunk = CHUNKSIZE;
+	h->grow_calls = GROW_WINDOW;
+	h->grow_last = 0;
 
 	/* extend heap with a free block of CHUNKSIZE */
-	if (extend_heap(CHUNKSIZE/WSIZE) == NULL)
+	if (extend_heap(h, CHUNKSIZE/WSIZE) == NULL)
 		return -1;
 
+	/* ADDON_5: blocks cached for the previous heap are no longer valid */
+	h->heap_gen++;
+
     return 0;
 }
 
 /* 
- * mm_malloc - Allocate a block by incrementing the brk pointer.
+ * heap_malloc - Allocate a block by incrementing the brk pointer.
  *     Always allocate a block whose size is a multiple of the alignment.
+ * ADDON_5: was mm_malloc; caller holds heap_lock.
  */
-void *mm_malloc(size_t size)
+static void *heap_malloc(mm_heap_t *h, size_t size)
 {
 
 	/* basic implementation of malloc */
@@ -156,48 +812,83 @@ void *mm_malloc(size_t size)
 
     /* pad the requested size, return if size too small */
     size_t asize;
-    size_t extendedsize;
     char *bp;
+    char *base = h->heap_base; /* ADDON_14: of the links */
 
     if (size == 0)
     	return NULL;
 
-    /* ADDON_1: minimum size can become DSIZE, in case size less than WSIZE*/
-    if (size <= DSIZE) {
-    	asize = 2*DSIZE;
-    } else {
-    	/* round up to nearest 8, and add 8 for overhead */
-    	/* ADDON_1: in case of no-footer design, overhead of 4 (potential error)*/
-    	asize = ((size + WSIZE + (DSIZE - 1))/DSIZE) * DSIZE;
+    /* ADDON_1: in case of no-footer design, overhead is only the header */
+    /* ADDON_2: a block must be able to hold the free list links once freed */
+    asize = ADJUST_SIZE(size);
+    h->grow_calls++;
+
+    /* ADDON_6: exact fit from a fast bin; the block is still allocated */
+    if ((asize <= FASTBIN_MAXSIZE) && ((bp = h->fastbins[asize/ALIGNMENT]) != NULL)) {
+    	h->fastbins[asize/ALIGNMENT] = NEXT_FREEP(base, bp);
+    	h->fast_count--;
+    	return bp;
     }
 
     /* search for suitable block via some fit method, and allocate */
-    if ((bp = first_fit(asize)) != NULL) {
-    	place(bp, asize);
-    	// mm_check();
+    if ((bp = best_fit(h, asize)) != NULL) {
+    	place(h, bp, asize);
+    	// mm_check(h);
     	return bp;
     }
 
+    /* ADDON_6: a large request that misses consolidates the fast bins */
+    if (h->fast_count && (asize > FASTBIN_MAXSIZE)) {
+    	defragment(h, h->fast_count);
+    	if ((bp = best_fit(h, asize)) != NULL) {
+    		place(h, bp, asize);
+    		return bp;
+    	}
+    }
+
 
     /* if no block large enough, extend heap, place+coalesce if possible, return bp */
-    extendedsize = MAX(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extendedsize/WSIZE)) == NULL) 
+    /* ADDON_11: the growth policy decides by how much; only asize is placed */
+    // extendedsize = MAX(asize, CHUNKSIZE);
+    if ((bp = grow_heap(h, asize)) == NULL) 
     	return NULL;
 
-    // mm_check();
-    place(bp, extendedsize);
+    // mm_check(h);
+    place(h, bp, asize);
     return bp;
 
 
 }
 
 /*
- * mm_free - 
+ * heap_free - 
  * naive: 	Freeing a block does nothing. 
  * implicit list: marks block as free, coalesces with free neighbours.
+ * ADDON_5: was mm_free; caller holds heap_lock.
  *
  */
-void mm_free(void *ptr)
+static void heap_free(mm_heap_t *h, void *ptr)
+{
+	size_t size = GET_SIZE(HDRP(ptr));
+	char *base = h->heap_base;
+
+	/* ADDON_6: park small blocks in a fast bin, still marked allocated */
+	if (h->fastbins_on && (size <= FASTBIN_MAXSIZE)) {
+		SET_NEXT_FREEP(base, ptr, h->fastbins[size/ALIGNMENT]);
+		h->fastbins[size/ALIGNMENT] = ptr;
+		if (++h->fast_count >= FASTBIN_THRESHOLD)
+			defragment(h, FASTBIN_BUDGET);
+		return;
+	}
+
+	free_block(h, ptr);
+}
+
+/*
+ * free_block - ADDON_6: the actual free, shared by heap_free and the
+ *     fast bin consolidation.
+ */
+static void free_block(mm_heap_t *h, void *ptr)
 {
 	
 	/* First implementation of free */
@@ -213,20 +904,29 @@ void mm_free(void *ptr)
 	PUT(FTRP(ptr), PACK(size, 0+prev_alloc));
 
 	/* ADDON_1: inform next block that the current one is free */
-	PUT(HDRP(NEXT_BLKP(ptr)), PACK(GET_SIZE(HDRP(NEXT_BLKP(ptr))), GET_ALLOC(HDRP(NEXT_BLKP(ptr)))));
+	/* ADDON_12: a released next block keeps its mark until it is merged */
+	PUT_SHARED(HDRP(NEXT_BLKP(ptr)), PACK(GET_SIZE(HDRP(NEXT_BLKP(ptr))), GET_ALLOC(HDRP(NEXT_BLKP(ptr))) + GET_RELEASED(HDRP(NEXT_BLKP(ptr)))));
 
-	coalesce(ptr);
+	/* ADDON_10: a large free block at the top goes back to memlib */
+	ptr = coalesce(h, ptr);
+	trim_heap(h, ptr);
+
+	/* ADDON_12: so do the pages of one anywhere else */
+	release_block(h, ptr);
 
 }
 
 /*
- * mm_realloc - 
+ * heap_realloc - 
  * basic: 	Implemented simply in terms of mm_malloc and mm_free
+ * ADDON_4:	resizes in place where the neighbours allow it, see above.
+ * ADDON_5: was mm_realloc; caller holds heap_lock.
  */
-void *mm_realloc(void *ptr, size_t size)
+static void *heap_realloc(mm_heap_t *h, void *ptr, size_t size)
 {
 
 	/* basic implementation of realloc */
+	/*
     void *oldptr = ptr;
     void *newptr;
     size_t copySize;
@@ -240,6 +940,77 @@ void *mm_realloc(void *ptr, size_t size)
     memcpy(newptr, oldptr, copySize);
     mm_free(oldptr);
     return newptr;
+	*/
+
+
+	/* ADDON_4: in-place implementation of realloc */
+	size_t asize, oldsize;
+	size_t prevsize, nextsize = 0;
+	char *prev, *next;
+	void *newptr;
+
+	if (ptr == NULL)
+		return heap_malloc(h, size);
+
+	if (size == 0) {
+		heap_free(h, ptr);
+		return NULL;
+	}
+
+	asize = ADJUST_SIZE(size);
+	oldsize = GET_SIZE(HDRP(ptr));
+
+	/* shrinking, or still fits: split off the tail */
+	if (asize <= oldsize) {
+		realloc_place(h, ptr, oldsize, asize);
+		return ptr;
+	}
+
+	next = NEXT_BLKP(ptr);
+	if (!GET_ALLOC(HDRP(next)))
+		nextsize = GET_SIZE(HDRP(next));
+
+	/* last block of the heap: extend by the shortfall only */
+	if ((GET_SIZE(HDRP(next)) == 0) || 
+		(nextsize && (GET_SIZE(HDRP(NEXT_BLKP(next))) == 0))) {
+
+		if (oldsize + nextsize < asize) {
+			/* the new free block must still be able to hold its links */
+			if (extend_heap(h, MAX(asize - oldsize - nextsize, MIN_BLKSIZE)/WSIZE) == NULL)
+				return NULL;
+			next = NEXT_BLKP(ptr);
+			nextsize = GET_SIZE(HDRP(next));
+		}
+	}
+
+	/* absorb the free next block */
+	if (nextsize && (oldsize + nextsize >= asize)) {
+		remove_free(h, next);
+		realloc_place(h, ptr, oldsize + nextsize, asize);
+		return ptr;
+	}
+
+	/* merge backwards: slide the payload down into the free previous block */
+	if (!GET_ALLOC_PREV(HDRP(ptr))) {
+		prev = PREV_BLKP(ptr);
+		prevsize = GET_SIZE(HDRP(prev));
+
+		if (prevsize + oldsize + nextsize >= asize) {
+			remove_free(h, prev);
+			if (nextsize)
+				remove_free(h, next);
+			memmove(prev, ptr, oldsize - WSIZE);
+			realloc_place(h, prev, prevsize + oldsize + nextsize, asize);
+			return prev;
+		}
+	}
+
+	/* no room around the block: copy */
+	if ((newptr = heap_malloc(h, size)) == NULL)
+		return NULL;
+	memcpy(newptr, ptr, MIN(size, oldsize - WSIZE));
+	heap_free(h, ptr);
+	return newptr;
 
 }
 
@@ -255,7 +1026,7 @@ void *mm_realloc(void *ptr, size_t size)
  * called when initializing the allocator, and when no block found.
  * NOTE: calling with small chunks might make debugging difficult
  */
-static void *extend_heap (size_t words)
+static void *extend_heap (mm_heap_t *h, size_t words)
 {
 	size_t size;
 	char *bp;
@@ -263,8 +1034,15 @@ static void *extend_heap (size_t words)
 	int prev_alloc;
 
 	/* allocate even nr of words */
-	size = (words % 2)? ((words+1) * WSIZE) : (words * WSIZE);
-	if ((long)(bp = mem_sbrk(size)) == -1)
+	// size = (words % 2)? ((words+1) * WSIZE) : (words * WSIZE);
+	/* ADDON_13: a whole number of ALIGNMENT units */
+	size = ALIGN(words * WSIZE);
+#if USE_COMPRESSED_LINKS
+	/* ADDON_14: every block must stay within reach of a link */
+	if (mem_arena_heapsize(h->arena) + size > LINK_MAXHEAP)
+		return NULL;
+#endif
+	if ((long)(bp = mem_arena_sbrk(h->arena, (intptr_t)size)) == -1)
 		return NULL;
 
 	/* ADDON_1: extract epilogue information before extension inserted */
@@ -275,17 +1053,44 @@ static void *extend_heap (size_t words)
 	PUT(FTRP(bp), PACK(size, 0+prev_alloc));
 	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* epilogue's prev. not allocated */
 
-	// mm_check();
+	// mm_check(h);
 
-	return coalesce(bp); /* coalesce if prev block free */
+	return coalesce(h, bp); /* coalesce if prev block free */
+
+}
 
+/*
+ * grow_heap - ADDON_11: extend the heap for a request of asize bytes that
+ *     found no fit. A free block at the top already covers part of it.
+ *     Returns the (coalesced, listed) free block at the top.
+ */
+static void *grow_heap(mm_heap_t *h, size_t asize)
+{
+	char *epilogue = (char *)mem_arena_hi(h->arena) + 1 - WSIZE;
+	unsigned long quiet = h->grow_calls - h->grow_last;
+	size_t top = 0;
+
+	/* the footer of a free last block sits right before the epilogue */
+	if (!GET_ALLOC_PREV(epilogue))
+		top = GET_SIZE(epilogue - WSIZE);
+
+	/* sustained growth doubles the step while it stays a small fraction
+	 * of the heap, quiet phases halve it */
+	if ((quiet < GROW_WINDOW) && (GROW_RATIO*h->grow_chunk <= mem_arena_heapsize(h->arena)))
+		h->grow_chunk = MIN(2*h->grow_chunk, GROW_MAXCHUNK);
+	for (; (quiet >= GROW_WINDOW) && (h->grow_chunk > CHUNKSIZE); quiet -= GROW_WINDOW)
+		h->grow_chunk /= 2;
+	h->grow_last = h->grow_calls;
+
+	return extend_heap(h, MAX(asize - top, h->grow_chunk)/WSIZE);
 }
 
 /* Coalesce with neighboring blocks if they are free. 
  * * this fcn assumes that the current block, bp, is free,
  * * and that it has info on previous block alloc status
+ * * ADDON_2: bp must not be on a free list yet; the result is.
  */
-static void *coalesce(void *bp) 
+static void *coalesce(mm_heap_t *h, void *bp) 
 {
 	/* status of neighbor blocks, size of current */
 	/* ADDON_1: previous alloc status should always be checked at current block hdr */
@@ -296,12 +1101,12 @@ static void *coalesce(void *bp)
 	int prev_prev_alloc;
 
 	/* possible cases when coalescing with neighbors */
+	/* ADDON_2: free neighbours leave their lists before their size changes */
 	if (prev_alloc & next_alloc) { /* both allocated */
-		// mm_check();
-
-		return bp;
+		// mm_check(h);
 
 	} else if (prev_alloc & (!next_alloc)) { /* coalesce with next*/
+		remove_free(h, NEXT_BLKP(bp));
 		size+= GET_SIZE(HDRP(NEXT_BLKP(bp)));
 		PUT(HDRP(bp), PACK(size, 0+2));
 		PUT(FTRP(bp), PACK(size, 0+2)); 
@@ -309,6 +1114,7 @@ static void *coalesce(void *bp)
 	} else if ((!prev_alloc) & next_alloc) { /* coalesce with prev */
 		/* ADDON_1: obtain info on the second to previous block. Necessarily allocated? */
 		prev_prev_alloc = GET_ALLOC_PREV(HDRP(PREV_BLKP(bp)));
+		remove_free(h, PREV_BLKP(bp));
 		size+= GET_SIZE(FTRP(PREV_BLKP(bp)));
 		PUT(HDRP(PREV_BLKP(bp)), PACK(size, prev_prev_alloc+0));
 		PUT(FTRP(bp), PACK(size, prev_prev_alloc+0));
@@ -317,6 +1123,8 @@ static void *coalesce(void *bp)
 	} else { /* coalesce with both */
 		/* ADDON_1: obtain info on the second to previous block. Necessarily allocated? */
 		prev_prev_alloc = GET_ALLOC_PREV(HDRP(PREV_BLKP(bp)));
+		remove_free(h, PREV_BLKP(bp));
+		remove_free(h, NEXT_BLKP(bp));
 		size+= GET_SIZE(FTRP(PREV_BLKP(bp))) + GET_SIZE(HDRP(NEXT_BLKP(bp)));
 		PUT(HDRP(PREV_BLKP(bp)), PACK(size, prev_prev_alloc+0));
 		PUT(FTRP(NEXT_BLKP(bp)), PACK(size, prev_prev_alloc+0));
@@ -325,9 +1133,11 @@ static void *coalesce(void *bp)
 
 
 	/* ADDON_0: This code needed for next_fit() */
-	if ((rover > bp) && (rover < NEXT_BLKP(bp)))
-		rover = (bp);
+	if ((h->rover > bp) && (h->rover < NEXT_BLKP(bp)))
+		h->rover = (bp);
 
+	/* ADDON_2: the coalesced block goes onto the list of its class */
+	insert_free(h, bp);
 
 	return bp;
 }
@@ -335,60 +1145,50 @@ static void *coalesce(void *bp)
 
 /* Fitment functions */
 
-/* first fit */
-static void *first_fit(size_t asize) 
+/* best fit; bad performance with implicit list; entire list must be scanned 
+ * ADDON_3: with the free blocks indexed, only the list of the request's
+ * class and the first non-empty class above it are scanned; beyond that
+ * the tree returns the smallest fitting size in O(log n).
+ */ 
+static void *best_fit(mm_heap_t *h, size_t asize) 
 {
+	char *bp;
 
-	void *bp = heap_listp; 
-	
-	// till we get to epilogue whose size is 0
-	while (GET_SIZE(HDRP(bp))) {
-	
-		if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp))))
-			return bp;
-		
-		bp = NEXT_BLKP(bp);
-	}
-
-	/* if not found */
-	return NULL;
-
-}
+	/* ADDON_7: exact classes, so the first non-empty one is the best */
+	if ((asize <= LIST_MAXSIZE) && ((bp = list_fit(h, asize)) != NULL))
+		return bp;
 
-/* best fit; bad performance with implicit list; entire list must be scanned */ 
-static void *best_fit(size_t asize) 
-{
-	return NULL;
+	return tree_search(h, asize);
 }
 
 /* next fit: performance almost identical to first_fit in implicit list.
  * start each search where the last stopped (rover), onwards till it wraps 
  * back to the beginning of the implicit list, and up to the rover. */
-static void *next_fit(size_t asize) 
+static void *next_fit(mm_heap_t *h, size_t asize) 
 {
 
-	void *oldrover = rover;
+	void *oldrover = h->rover;
 	
 	/* from rover to end of block list */
-	while (GET_SIZE(HDRP(rover))) {
+	while (GET_SIZE(HDRP(h->rover))) {
 	
-		if (!GET_ALLOC(HDRP(rover)) && (asize <= GET_SIZE(HDRP(rover)))) {
-			return rover;
+		if (!GET_ALLOC(HDRP(h->rover)) && (asize <= GET_SIZE(HDRP(h->rover)))) {
+			return h->rover;
 		}
 		
-		rover = NEXT_BLKP(rover);
+		h->rover = NEXT_BLKP(h->rover);
 	}
 
 
 	/* from start of block list to rover */
-	rover = (heap_listp);
-	while (/*GET_SIZE(HDRP(rover)) &&*/ (rover < oldrover)) {
+	h->rover = (h->heap_listp);
+	while (/*GET_SIZE(HDRP(rover)) &&*/ (h->rover < oldrover)) {
 
-		if (!GET_ALLOC(HDRP(rover)) && (asize <= GET_SIZE(HDRP(rover)))) {
-			return rover;
+		if (!GET_ALLOC(HDRP(h->rover)) && (asize <= GET_SIZE(HDRP(h->rover)))) {
+			return h->rover;
 		}
 		
-		rover = NEXT_BLKP(rover);
+		h->rover = NEXT_BLKP(h->rover);
 	}
 
 	/* if not found */
@@ -401,10 +1201,14 @@ static void *next_fit(size_t asize)
  * after this call, bp points to an allocated block.
  * it may produce an unallocated next block.
  */
-static void place(void *bp, size_t asize) {
+static void place(mm_heap_t *h, void *bp, size_t asize) {
 
 	size_t remainder = GET_SIZE(HDRP(bp)) - asize;
-	size_t minimum_split = 2*DSIZE; // remainder
+	size_t minimum_split = MIN_BLKSIZE; // remainder
+	int released = GET_RELEASED(HDRP(bp)); /* ADDON_12 */
+
+	/* ADDON_2: the block is no longer free */
+	remove_free(h, bp);
 
 	if ( remainder >= (minimum_split) ) { // split
 		
@@ -418,6 +1222,10 @@ static void place(void *bp, size_t asize) {
 		bp = NEXT_BLKP(bp);
 		PUT(HDRP(bp), PACK(remainder, 0+2));
 		PUT(FTRP(bp), PACK(remainder, 0+2));
+		insert_free(h, bp);
+		/* ADDON_12: the pages the remainder keeps are still released */
+		if (released)
+			release_block(h, bp);
 		
 	} else { // keep current block size
 		/* store status of current block */
@@ -426,26 +1234,707 @@ static void place(void *bp, size_t asize) {
 		// PUT(FTRP(bp), PACK(GET_SIZE(HDRP(bp)), 1)); 
 
 		/* ADDON_1: inform next block that current is allocated */
-		PUT(HDRP(NEXT_BLKP(bp)), PACK(GET_SIZE(HDRP(NEXT_BLKP(bp))), GET_ALLOC(HDRP(NEXT_BLKP(bp))) + 2));
+		PUT_SHARED(HDRP(NEXT_BLKP(bp)), PACK(GET_SIZE(HDRP(NEXT_BLKP(bp))), GET_ALLOC(HDRP(NEXT_BLKP(bp))) + 2));
 	
 	}
 	return;
 }
 
-/* a defrag routine, called at every free. Coalesces if a block is unallocated. */
-static void defragment(void)
+/* ADDON_2: free list helpers */
+
+/* ADDON_7: head of the first non-empty list at or above the class of
+ * asize (<= LIST_MAXSIZE), found by a bit scan of class_map */
+static char *list_fit(mm_heap_t *h, size_t asize)
+{
+	int c = SIZE_CLASS(asize);
+	unsigned long long map = h->class_map >> c;
+
+	if (map == 0)
+		return NULL;
+	return h->seg_lists[c + __builtin_ctzll(map)];
+}
+
+/* push a free block onto the front of the list of its class 
+ * ADDON_3: or into the tree, if it is too large for the lists */
+static void insert_free(mm_heap_t *h, void *bp)
+{
+	int c;
+	char *head;
+	char *base = h->heap_base;
+
+	if (GET_SIZE(HDRP(bp)) > LIST_MAXSIZE) {
+		h->tree_root = tree_insert(base, h->tree_root, bp);
+		return;
+	}
+
+	c = SIZE_CLASS(GET_SIZE(HDRP(bp)));
+	head = h->seg_lists[c];
+
+	SET_NEXT_FREEP(base, bp, head);
+	SET_PREV_FREEP(base, bp, NULL);
+	if (head != NULL)
+		SET_PREV_FREEP(base, head, bp);
+	h->seg_lists[c] = bp;
+	h->class_map |= 1ULL << c;
+}
+
+/* unlink a free block; its header must still hold the listed size */
+static void remove_free(mm_heap_t *h, void *bp)
+{
+	char *base = h->heap_base;
+	char *prev = PREV_FREEP(base, bp);
+	char *next = NEXT_FREEP(base, bp);
+	int c;
+
+	/* ADDON_12: it leaves to be used, merged or resized */
+	reclaim_block(h, bp);
+
+	/* ADDON_3: a tree node (no predecessor) must be taken out of the tree */
+	if ((GET_SIZE(HDRP(bp)) > LIST_MAXSIZE) && (prev == NULL)) {
+		h->tree_root = tree_remove(base, h->tree_root, bp);
+		return;
+	}
+
+	if (prev != NULL) {
+		SET_NEXT_FREEP(base, prev, next);
+	} else {
+		c = SIZE_CLASS(GET_SIZE(HDRP(bp)));
+		h->seg_lists[c] = next;
+		/* ADDON_7: an emptied list leaves the class bitmap */
+		if (next == NULL)
+			h->class_map &= ~(1ULL << c);
+	}
+
+	if (next != NULL)
+		SET_PREV_FREEP(base, next, prev);
+}
+
+/* ADDON_3: AVL tree of large free blocks, keyed on size */
+
+#define TREE_SIZE(n) (GET_SIZE(HDRP(n)))
+#define TREE_HEIGHT(n) ((n) ? (int)GET(TREE_HEIGHTP(n)) : 0)
+
+/* recompute the height of n from its children */
+static void tree_update(char *base, char *n)
+{
+	int hl = TREE_HEIGHT(LEFT_CHILD(base, n));
+	int hr = TREE_HEIGHT(RIGHT_CHILD(base, n));
+
+	PUT(TREE_HEIGHTP(n), MAX(hl, hr) + 1);
+}
+
+static char *tree_rotate_right(char *base, char *n)
+{
+	char *l = LEFT_CHILD(base, n);
+
+	SET_LEFT_CHILD(base, n, RIGHT_CHILD(base, l));
+	SET_RIGHT_CHILD(base, l, n);
+	tree_update(base, n);
+	tree_update(base, l);
+	return l;
+}
+
+static char *tree_rotate_left(char *base, char *n)
+{
+	char *r = RIGHT_CHILD(base, n);
+
+	SET_RIGHT_CHILD(base, n, LEFT_CHILD(base, r));
+	SET_LEFT_CHILD(base, r, n);
+	tree_update(base, n);
+	tree_update(base, r);
+	return r;
+}
+
+/* restore the AVL property at n, return the new subtree root */
+static char *tree_balance(char *base, char *n)
+{
+	char *l = LEFT_CHILD(base, n);
+	char *r = RIGHT_CHILD(base, n);
+	int bf = TREE_HEIGHT(l) - TREE_HEIGHT(r);
+
+	if (bf > 1) {
+		if (TREE_HEIGHT(LEFT_CHILD(base, l)) < TREE_HEIGHT(RIGHT_CHILD(base, l)))
+			SET_LEFT_CHILD(base, n, tree_rotate_left(base, l));
+		return tree_rotate_right(base, n);
+	}
+	if (bf < -1) {
+		if (TREE_HEIGHT(RIGHT_CHILD(base, r)) < TREE_HEIGHT(LEFT_CHILD(base, r)))
+			SET_RIGHT_CHILD(base, n, tree_rotate_right(base, r));
+		return tree_rotate_left(base, n);
+	}
+
+	tree_update(base, n);
+	return n;
+}
+
+/* insert bp into the subtree n, return the new subtree root. 
+ * a block whose size is already in the tree is chained behind that node */
+static char *tree_insert(char *base, char *n, char *bp)
+{
+	char *next;
+
+	if (n == NULL) {
+		SET_NEXT_FREEP(base, bp, NULL);
+		SET_PREV_FREEP(base, bp, NULL);
+		SET_LEFT_CHILD(base, bp, NULL);
+		SET_RIGHT_CHILD(base, bp, NULL);
+		PUT(TREE_HEIGHTP(bp), 1);
+		return bp;
+	}
+
+	if (TREE_SIZE(bp) == TREE_SIZE(n)) {
+		next = NEXT_FREEP(base, n);
+		SET_NEXT_FREEP(base, bp, next);
+		SET_PREV_FREEP(base, bp, n);
+		if (next != NULL)
+			SET_PREV_FREEP(base, next, bp);
+		SET_NEXT_FREEP(base, n, bp);
+		return n;
+	}
+
+	if (TREE_SIZE(bp) < TREE_SIZE(n))
+		SET_LEFT_CHILD(base, n, tree_insert(base, LEFT_CHILD(base, n), bp));
+	else
+		SET_RIGHT_CHILD(base, n, tree_insert(base, RIGHT_CHILD(base, n), bp));
+
+	return tree_balance(base, n);
+}
+
+/* detach the smallest node of subtree n into *minp */
+static char *tree_remove_min(char *base, char *n, char **minp)
+{
+	if (LEFT_CHILD(base, n) == NULL) {
+		*minp = n;
+		return RIGHT_CHILD(base, n);
+	}
+
+	SET_LEFT_CHILD(base, n, tree_remove_min(base, LEFT_CHILD(base, n), minp));
+	return tree_balance(base, n);
+}
+
+/* remove tree node bp from subtree n, return the new subtree root.
+ * if other blocks of that size are chained behind bp, the first one
+ * simply takes over its place in the tree */
+static char *tree_remove(char *base, char *n, char *bp)
+{
+	char *succ, *right;
+
+	if (TREE_SIZE(bp) < TREE_SIZE(n)) {
+		SET_LEFT_CHILD(base, n, tree_remove(base, LEFT_CHILD(base, n), bp));
+		return tree_balance(base, n);
+	}
+	if (TREE_SIZE(bp) > TREE_SIZE(n)) {
+		SET_RIGHT_CHILD(base, n, tree_remove(base, RIGHT_CHILD(base, n), bp));
+		return tree_balance(base, n);
+	}
+
+	/* n == bp */
+	if ((succ = NEXT_FREEP(base, n)) != NULL) {
+		SET_PREV_FREEP(base, succ, NULL);
+		SET_LEFT_CHILD(base, succ, LEFT_CHILD(base, n));
+		SET_RIGHT_CHILD(base, succ, RIGHT_CHILD(base, n));
+		PUT(TREE_HEIGHTP(succ), GET(TREE_HEIGHTP(n)));
+		return succ;
+	}
+
+	if (LEFT_CHILD(base, n) == NULL)
+		return RIGHT_CHILD(base, n);
+	if (RIGHT_CHILD(base, n) == NULL)
+		return LEFT_CHILD(base, n);
+
+	right = tree_remove_min(base, RIGHT_CHILD(base, n), &succ);
+	SET_LEFT_CHILD(base, succ, LEFT_CHILD(base, n));
+	SET_RIGHT_CHILD(base, succ, right);
+	return tree_balance(base, succ);
+}
+
+/* smallest free block in the tree with size >= asize. a chained block
+ * is preferred over the node itself, since unlinking it is O(1) */
+static char *tree_search(mm_heap_t *h, size_t asize)
+{
+	char *base = h->heap_base;
+	char *n = h->tree_root;
+	char *best = NULL;
+
+	while (n != NULL) {
+		if (TREE_SIZE(n) == asize) {
+			best = n;
+			break;
+		}
+		if (TREE_SIZE(n) > asize) {
+			best = n;
+			n = LEFT_CHILD(base, n);
+		} else {
+			n = RIGHT_CHILD(base, n);
+		}
+	}
+
+	if ((best != NULL) && (NEXT_FREEP(base, best) != NULL))
+		return NEXT_FREEP(base, best);
+	return best;
+}
+
+/* ADDON_4: placement helper for realloc.
+ * bp is the start of total contiguous bytes that are on no free list; 
+ * makes bp an allocated block of asize and frees any usable remainder,
+ * which is coalesced with a free next block.
+ */
+static void realloc_place(mm_heap_t *h, void *bp, size_t total, size_t asize)
+{
+	size_t remainder = total - asize;
+	int prev_alloc = GET_ALLOC_PREV(HDRP(bp));
+	char *next;
+
+	if (remainder >= MIN_BLKSIZE) { // split
+		PUT(HDRP(bp), PACK(asize, prev_alloc + 1));
+
+		bp = NEXT_BLKP(bp);
+		PUT(HDRP(bp), PACK(remainder, 0+2));
+		PUT(FTRP(bp), PACK(remainder, 0+2));
+
+		/* inform next block that its previous is free; a released one
+		 * keeps its mark until it is merged (ADDON_12) */
+		next = NEXT_BLKP(bp);
+		PUT_SHARED(HDRP(next), PACK(GET_SIZE(HDRP(next)), GET_ALLOC(HDRP(next)) + GET_RELEASED(HDRP(next))));
+
+		coalesce(h, bp);
+
+	} else {
+		PUT(HDRP(bp), PACK(total, prev_alloc + 1));
+
+		/* inform next block that current is allocated */
+		next = NEXT_BLKP(bp);
+		PUT_SHARED(HDRP(next), PACK(GET_SIZE(HDRP(next)), GET_ALLOC(HDRP(next)) + 2));
+	}
+}
+
+/* ADDON_5: per-thread cache */
+
+/* pop a cached block of exactly asize bytes, NULL on a miss */
+static void *tcache_get(mm_heap_t *h, size_t asize)
+{
+	size_t bin = asize / ALIGNMENT;
+	tcache_t *tc;
+	char *bp;
+
+	if (asize > TCACHE_MAXSIZE)
+		return NULL;
+
+	tc = (tcache_t *)pthread_getspecific(h->tcache_key);
+	if ((tc == NULL) || (tc->gen != h->heap_gen) || (tc->count[bin] == 0))
+		return NULL;
+
+	bp = tc->head[bin];
+	tc->head[bin] = NEXT_FREEP(h->heap_base, bp);
+	tc->count[bin]--;
+	return bp;
+}
+
+/* push an allocated block onto its bin; returns 0 if it must go 
+ * to the central heap instead */
+static int tcache_put(mm_heap_t *h, void *bp, size_t asize)
+{
+	size_t bin = asize / ALIGNMENT;
+	tcache_t *tc;
+
+	if (asize > TCACHE_MAXSIZE)
+		return 0;
+
+	if ((tc = (tcache_t *)pthread_getspecific(h->tcache_key)) == NULL) {
+		/* AN: first use of h by this thread; h keeps a list of its 
+		 * caches, so mm_heap_destroy can free them */
+		if ((tc = (tcache_t *)calloc(1, sizeof(tcache_t))) == NULL)
+			return 0;
+		tc->heap = h;
+		pthread_mutex_lock(&h->heap_lock);
+		tc->next = h->tcaches;
+		if (tc->next != NULL)
+			tc->next->prev = tc;
+		h->tcaches = tc;
+		pthread_mutex_unlock(&h->heap_lock);
+		pthread_setspecific(h->tcache_key, tc);
+	}
+
+	if (tc->gen != h->heap_gen) {
+		/* first use by this thread, or the heap was reinitialized */
+		memset(tc->count, 0, sizeof(tc->count));
+		memset(tc->head, 0, sizeof(tc->head));
+		tc->gen = h->heap_gen;
+	}
+
+	if (tc->count[bin] >= TCACHE_COUNT)
+		return 0;
+
+	SET_NEXT_FREEP(h->heap_base, bp, tc->head[bin]);
+	tc->head[bin] = bp;
+	tc->count[bin]++;
+	return 1;
+}
+
+/* return every block of a thread's cache to the central heap. 
+ * runs as the thread-specific data destructor when a thread exits 
+ * AN: and frees the cache, which leaves the list of its heap */
+static void tcache_flush(void *arg)
+{
+	tcache_t *tc = (tcache_t *)arg;
+	mm_heap_t *h = tc->heap;
+	size_t bin;
+	char *bp;
+
+	pthread_mutex_lock(&h->heap_lock);
+	if (tc->gen == h->heap_gen) {
+		for (bin = 0; bin < TCACHE_BINS; bin++) {
+			while ((bp = tc->head[bin]) != NULL) {
+				tc->head[bin] = NEXT_FREEP(h->heap_base, bp);
+				if (slab_owns(h, bp))
+					slab_free(h, bp);
+				else
+					heap_free(h, bp);
+			}
+			tc->count[bin] = 0;
+		}
+	}
+	if (tc->prev != NULL)
+		tc->prev->next = tc->next;
+	else
+		h->tcaches = tc->next;
+	if (tc->next != NULL)
+		tc->next->prev = tc->prev;
+	pthread_mutex_unlock(&h->heap_lock);
+	free(tc);
+}
+
+/* AN: the key of the default instance's caches, made by the first mm_init */
+static void heap_default_key(void)
+{
+	pthread_key_create(&heap_default.tcache_key, tcache_flush);
+}
+
+/* ADDON_8: slab sub-allocator */
+
+/* allocate a heap block of asize bytes whose payload is aligned to align
+ * (a power of 2). the free space in front of it stays a free block. */
+static void *heap_alloc_aligned(mm_heap_t *h, size_t align, size_t asize)
+{
+	size_t need = asize + align + MIN_BLKSIZE;
+	size_t size, pad;
+	int prev_alloc;
+	char *bp, *ap;
+
+	if ((bp = best_fit(h, need)) == NULL) {
+		if ((bp = grow_heap(h, need)) == NULL)
+			return NULL;
+	}
+
+	remove_free(h, bp);
+	size = GET_SIZE(HDRP(bp));
+	prev_alloc = GET_ALLOC_PREV(HDRP(bp));
+
+	/* first aligned payload that leaves no sliver in front of it */
+	ap = (char *)(((unsigned long)bp + align - 1) & ~(unsigned long)(align - 1));
+	if ((ap != bp) && ((size_t)(ap - bp) < MIN_BLKSIZE))
+		ap += align;
+	pad = ap - bp;
+
+	if (pad) {
+		PUT(HDRP(bp), PACK(pad, 0+prev_alloc));
+		PUT(FTRP(bp), PACK(pad, 0+prev_alloc));
+		insert_free(h, bp);
+		prev_alloc = 0;
+	}
+
+	/* the aligned rest is a free block; place it like any other */
+	PUT(HDRP(ap), PACK(size - pad, 0+prev_alloc));
+	PUT(FTRP(ap), PACK(size - pad, 0+prev_alloc));
+	insert_free(h, ap);
+	place(h, ap, asize);
+
+	return ap;
+}
+
+/* does ptr point into a slab run? safe without the lock: the bit of a 
+ * page with a live object (or a live heap block) cannot change under it.
+ * the bits of other pages in the same byte can, so the byte is read and
+ * written atomically */
+static int slab_owns(mm_heap_t *h, void *ptr)
+{
+	unsigned long page;
+
+	if ((unsigned long)ptr < h->run_base)
+		return 0;
+
+	page = ((unsigned long)ptr - h->run_base) / RUNSIZE;
+	if (page >= h->run_pages)
+		return 0;
+
+	return (__atomic_load_n(&h->run_map[page / 8], __ATOMIC_RELAXED) >> (page % 8)) & 1;
+}
+
+/* set up a fresh run for class c and put it on the list of its class */
+static run_t *slab_new_run(mm_heap_t *h, int c)
+{
+	run_t *run;
+	unsigned long page;
+	unsigned int i;
+
+	if ((run = heap_alloc_aligned(h, RUNSIZE, RUNSIZE)) == NULL)
+		return NULL;
+
+	page = ((unsigned long)run - h->run_base) / RUNSIZE;
+	__atomic_fetch_or(&h->run_map[page / 8], 1 << (page % 8), __ATOMIC_RELAXED);
+
+	/* the run block's payload ends one header short of the page */
+	run->objsize = slab_sizes[c];
+	run->first = ALIGN(sizeof(run_t));
+	run->nobjs = (RUNSIZE - WSIZE - run->first) / run->objsize;
+	run->nfree = run->nobjs;
+
+	/* bits past the last object stay set, so they are never handed out */
+	memset(run->map, 0xff, sizeof(run->map));
+	for (i = 0; i < run->nobjs; i++)
+		run->map[i / 64] &= ~(1ULL << (i % 64));
+
+	run->prev = NULL;
+	run->next = h->slab_runs[c];
+	if (run->next != NULL)
+		run->next->prev = run;
+	h->slab_runs[c] = run;
+
+	return run;
+}
+
+/* unlink a run from the list of runs with room */
+static void slab_unlink(mm_heap_t *h, run_t *run, int c)
+{
+	if (run->prev != NULL)
+		run->prev->next = run->next;
+	else
+		h->slab_runs[c] = run->next;
+	if (run->next != NULL)
+		run->next->prev = run->prev;
+}
+
+/* hand out an object of class c, NULL if no run can be had */
+static void *slab_alloc(mm_heap_t *h, int c)
+{
+	run_t *run = h->slab_runs[c];
+	unsigned int w, i;
+
+	if ((run == NULL) && ((run = slab_new_run(h, c)) == NULL))
+		return NULL;
+
+	for (w = 0; ~run->map[w] == 0; w++)
+		;
+	i = __builtin_ctzll(~run->map[w]);
+	run->map[w] |= 1ULL << i;
+
+	/* a full run leaves the list */
+	if (--run->nfree == 0)
+		slab_unlink(h, run, c);
+
+	return (char *)run + run->first + (w*64 + i) * run->objsize;
+}
+
+/* return an object to its run; an empty run goes back to the heap 
+ * unless it is the only run of its class with room */
+static void slab_free(mm_heap_t *h, void *ptr)
+{
+	run_t *run = RUN_OF(ptr);
+	unsigned int i = ((char *)ptr - (char *)run - run->first) / run->objsize;
+	unsigned long page;
+	int c = slab_class[(run->objsize - 1) / DSIZE];
+
+	run->map[i / 64] &= ~(1ULL << (i % 64));
+
+	/* a full run has room again */
+	if (run->nfree++ == 0) {
+		run->prev = NULL;
+		run->next = h->slab_runs[c];
+		if (run->next != NULL)
+			run->next->prev = run;
+		h->slab_runs[c] = run;
+	}
+
+	if ((run->nfree == run->nobjs) && ((run->prev != NULL) || (run->next != NULL))) {
+		slab_unlink(h, run, c);
+		page = ((unsigned long)run - h->run_base) / RUNSIZE;
+		__atomic_fetch_and(&h->run_map[page / 8], ~(1 << (page % 8)), __ATOMIC_RELAXED);
+		free_block(h, run);
+	}
+}
+
+/*
+ * trim_heap - ADDON_10: if the free, listed block bp is the last one and
+ *     at least TRIM_THRESHOLD bytes, shrink it to TRIM_KEEP bytes and 
+ *     move the epilogue and the break down behind it.
+ */
+static void trim_heap(mm_heap_t *h, void *bp)
+{
+	size_t size = GET_SIZE(HDRP(bp));
+	size_t release;
+	int prev_alloc;
+
+	if ((GET_SIZE(HDRP(NEXT_BLKP(bp))) != 0) || (size < TRIM_THRESHOLD))
+		return;
+
+	release = size - TRIM_KEEP;
+	prev_alloc = GET_ALLOC_PREV(HDRP(bp));
+
+	/* relist under the new size */
+	remove_free(h, bp);
+	PUT(HDRP(bp), PACK(TRIM_KEEP, 0+prev_alloc));
+	PUT(FTRP(bp), PACK(TRIM_KEEP, 0+prev_alloc));
+	PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* epilogue's prev. not allocated */
+	insert_free(h, bp);
+
+	mem_arena_sbrk(h->arena, -(intptr_t)release);
+}
+
+/*
+ * release_block - ADDON_12: if the free, listed block bp is at least 
+ *     RELEASE_MINSIZE bytes, release the whole pages of its interior and
+ *     mark it.
+ */
+static void release_block(mm_heap_t *h, void *bp)
+{
+	if (GET_SIZE(HDRP(bp)) < RELEASE_MINSIZE)
+		return;
+
+	mem_arena_release(h->arena, (char *)bp + RELEASE_OFFSET, FTRP(bp) - 1);
+
+	SET_RELEASED(HDRP(bp));
+	SET_RELEASED(FTRP(bp));
+}
+
+/*
+ * reclaim_block - ADDON_12: if the free block bp is marked released, its
+ *     pages are about to be used again; take them out of the released 
+ *     count. The caller's rewrite of the tags drops the mark.
+ */
+static void reclaim_block(mm_heap_t *h, void *bp)
 {
+	if (GET_RELEASED(HDRP(bp)))
+		mem_arena_reclaim(h->arena, (char *)bp + RELEASE_OFFSET, FTRP(bp) - 1);
+}
+
+/* ADDON_9: large objects */
 
+/*
+ * large_owns - is ptr a large object? Those are the only payloads outside
+ *     the heap. Safe without the lock: the range reserved for the heap 
+ *     does not change, where the break does.
+ */
+static int large_owns(mm_heap_t *h, void *ptr)
+{
+	return ((char *)ptr < h->heap_base) || 
+		((char *)ptr >= h->heap_end);
+}
+
+/*
+ * large_alloc - map a region for a payload of size bytes and list it.
+ *     Caller holds heap_lock.
+ */
+static void *large_alloc(mm_heap_t *h, size_t size)
+{
+	size_t mapsize = (size + LARGE_HDRSIZE + mem_pagesize() - 1) & 
+		~(mem_pagesize() - 1);
+	large_t *lp;
+
+	if ((lp = mem_arena_map(h->arena, mapsize)) == (void *)-1)
+		return NULL;
+
+	lp->size = mapsize;
+	lp->prev = NULL;
+	lp->next = h->large_list;
+	if (h->large_list != NULL)
+		h->large_list->prev = lp;
+	h->large_list = lp;
+
+	return (char *)lp + LARGE_HDRSIZE;
+}
+
+/*
+ * large_free - unlist a large object and unmap its region.
+ *     Caller holds heap_lock.
+ */
+static void large_free(mm_heap_t *h, void *ptr)
+{
+	large_t *lp = LARGE_OF(ptr);
+
+	if (lp->prev != NULL)
+		lp->prev->next = lp->next;
+	else
+		h->large_list = lp->next;
+	if (lp->next != NULL)
+		lp->next->prev = lp->prev;
+
+	mem_arena_unmap(h->arena, lp);
+}
+
+/*
+ * large_realloc - resize the region of a large object to the pages that
+ *     size bytes need; it may move. Caller holds heap_lock.
+ */
+static void *large_realloc(mm_heap_t *h, void *ptr, size_t size)
+{
+	size_t mapsize = (size + LARGE_HDRSIZE + mem_pagesize() - 1) & 
+		~(mem_pagesize() - 1);
+	large_t *lp = LARGE_OF(ptr);
+
+	if (mapsize == lp->size)
+		return ptr;
+
+	if ((lp = mem_arena_remap(h->arena, lp, mapsize)) == (void *)-1)
+		return NULL;
+
+	/* the list links point at the old place if the region moved */
+	lp->size = mapsize;
+	if (lp->prev != NULL)
+		lp->prev->next = lp;
+	else
+		h->large_list = lp;
+	if (lp->next != NULL)
+		lp->next->prev = lp;
+
+	return (char *)lp + LARGE_HDRSIZE;
+}
+
+/* a defrag routine, called at every free. Coalesces if a block is unallocated. 
+ * ADDON_6: with eager coalescing there is never anything to merge on the
+ * implicit list, so this is now the batch coalescer for the fast bins:
+ * up to budget parked blocks are freed for real, each coalescing with 
+ * its free neighbours. A neighbour that is still parked looks allocated,
+ * and merges in when its own turn comes.
+ */
+static void defragment(mm_heap_t *h, size_t budget)
+{
+
+	/*
 	void *bp = heap_listp;
 
 	while (GET_SIZE(HDRP(bp))) {
 
-		if (!(GET_ALLOC(HDRP(bp))))
-			bp = coalesce(bp);
+		if (!(GET_ALLOC(HDRP(bp)))) {
+			remove_free(h, bp);
+			bp = coalesce(h, bp);
+		}
 		
 		bp = NEXT_BLKP(bp);
 	}
+	*/
 
+	size_t bin;
+	char *bp;
+	char *base = h->heap_base;
+
+	for (bin = 0; (bin < FASTBIN_BINS) && budget; bin++) {
+		while (budget && ((bp = h->fastbins[bin]) != NULL)) {
+			h->fastbins[bin] = NEXT_FREEP(base, bp);
+			h->fast_count--;
+			budget--;
+			free_block(h, bp);
+		}
+	}
 
 }
 
@@ -463,13 +1952,14 @@ static void defragment(void)
  * check if they overlap, as the driver calls mm_malloc and scans the LL 
  * struct nodes.
  */
-static int mm_check(void)
+static int mm_check(mm_heap_t *h)
 {
 	
 	/* any contiguous free blocks that escaped coalescing? */
 	int prev_allocated = 1;
 	int unmerged_free_blocks = 0; // counts each border bracketed by free blox
-	void *bp = heap_listp;
+	void *bp = h->heap_listp;
+	char *base = h->heap_base;
 
 
 	while (GET_SIZE(HDRP(bp))) {
@@ -486,12 +1976,91 @@ static int mm_check(void)
 
 	printf("There are %d unmerged free blocks. \n", unmerged_free_blocks);
 
+	/* ADDON_2: is every free block in a free list, and only free blocks? */
+	int heap_free_blocks = 0;
+	int listed_free_blocks = 0;
+	int c;
+	char *fp;
+
+	for (bp = h->heap_listp; GET_SIZE(HDRP(bp)); bp = NEXT_BLKP(bp))
+		if (!GET_ALLOC(HDRP(bp)))
+			heap_free_blocks++;
+
+	for (c = 0; c < NUM_CLASSES; c++) {
+		/* ADDON_7: does the bitmap agree with the lists? */
+		if (((h->class_map >> c) & 1) != (h->seg_lists[c] != NULL))
+			printf("Class bitmap is wrong for list %d. \n", c);
+
+		for (fp = h->seg_lists[c]; fp != NULL; fp = NEXT_FREEP(base, fp)) {
+			listed_free_blocks++;
+
+			if (GET_ALLOC(HDRP(fp)))
+				printf("Block %p in free list %d is allocated. \n", fp, c);
+			if (SIZE_CLASS(GET_SIZE(HDRP(fp))) != c)
+				printf("Block %p is in the wrong free list (%d). \n", fp, c);
+			if ((fp < (char *)mem_arena_lo(h->arena)) || (fp > (char *)mem_arena_hi(h->arena)))
+				printf("Free list %d points outside the heap (%p). \n", c, fp);
+			if ((NEXT_FREEP(base, fp) != NULL) && (PREV_FREEP(base, NEXT_FREEP(base, fp)) != fp))
+				printf("Free list %d is broken after %p. \n", c, fp);
+		}
+	}
 
-	return 1; // HEAP OK
+	/* ADDON_6: do the fast bins hold what they claim, and only allocated blocks? */
+	size_t parked = 0;
+	size_t bin;
+
+	for (bin = 0; bin < FASTBIN_BINS; bin++) {
+		for (fp = h->fastbins[bin]; fp != NULL; fp = NEXT_FREEP(base, fp)) {
+			parked++;
+			if (!GET_ALLOC(HDRP(fp)) || (GET_SIZE(HDRP(fp)) != bin*DSIZE))
+				printf("Block %p in fast bin %d is corrupt. \n", fp, (int)bin);
+		}
+	}
+	if (parked != h->fast_count)
+		printf("%d blocks in fast bins, but fast_count is %d. \n", 
+			(int)parked, (int)h->fast_count);
+
+	/* ADDON_3: is the tree ordered and balanced? */
+	if (tree_check(base, h->tree_root, LIST_MAXSIZE, (size_t)-1, &listed_free_blocks) < 0) {
+		printf("The free block tree is corrupt. \n");
+		return 0;
+	}
+
+	if (heap_free_blocks != listed_free_blocks) {
+		printf("%d free blocks in heap, but %d in free lists. \n", 
+			heap_free_blocks, listed_free_blocks);
+		return 0;
+	}
+
+	return (unmerged_free_blocks == 0); // HEAP OK
 
 }
 
+/* ADDON_3: checks that subtree n holds sizes in (lo, hi), is AVL balanced,
+ * and that its blocks are free. adds the blocks found (nodes and chained
+ * blocks) to *count. returns the subtree height, or -1 if corrupt. */
+static int tree_check(char *base, char *n, size_t lo, size_t hi, int *count)
+{
+	int hl, hr;
+	char *fp;
+
+	if (n == NULL)
+		return 0;
 
+	if ((TREE_SIZE(n) <= lo) || (TREE_SIZE(n) >= hi) || (PREV_FREEP(base, n) != NULL))
+		return -1;
 
+	for (fp = n; fp != NULL; fp = NEXT_FREEP(base, fp)) {
+		(*count)++;
+		if (GET_ALLOC(HDRP(fp)) || (TREE_SIZE(fp) != TREE_SIZE(n)))
+			return -1;
+	}
 
+	hl = tree_check(base, LEFT_CHILD(base, n), lo, TREE_SIZE(n), count);
+	hr = tree_check(base, RIGHT_CHILD(base, n), TREE_SIZE(n), hi, count);
+	if ((hl < 0) || (hr < 0) || (hl - hr > 1) || (hr - hl > 1) || 
+		(TREE_HEIGHT(n) != MAX(hl, hr) + 1))
+		return -1;
 
+	return TREE_HEIGHT(n);
+}
@@ -5,6 +5,26 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 
+/* AN: allocator options, used by the driver */
+extern void mm_set_fastbins(int on);
+
+/* AN: the paths mm_malloc takes by request size: slab objects, the free
+ * lists, the tree, large objects. mm_path_limits gives the largest 
+ * request of each but the last. */
+#define MM_PATHS 4
+extern void mm_path_limits(size_t limits[MM_PATHS - 1]);
+
+/* AN: independent allocator instances, each on its own memlib arena */
+typedef struct mm_heap_t mm_heap_t;
+struct mem_arena_t;
+
+extern mm_heap_t *mm_heap_create(struct mem_arena_t *arena);
+extern void mm_heap_destroy(mm_heap_t *h);
+extern void *mm_heap_malloc(mm_heap_t *h, size_t size);
+extern void mm_heap_free(mm_heap_t *h, void *ptr);
+extern void *mm_heap_realloc(mm_heap_t *h, void *ptr, size_t size);
+extern void mm_heap_set_fastbins(mm_heap_t *h, int on);
+
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, 
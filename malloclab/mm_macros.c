@@ -8,6 +8,7 @@
 #define CHUNKSIZE (1<<12)
 
 #define MAX(x, y) ( ((x) > (y)) ? (x) : (y) )
+#define MIN(x, y) ( ((x) < (y)) ? (x) : (y) )
 
 
 /* helper operations, getters, setters 
@@ -33,3 +34,95 @@
  * is in the next bit.
  */
 #define GET_ALLOC_PREV(p) (GET(p) & 0x2)
+
+/* ADDON_5: the header of a live block, read by its owner without the 
+ * heap lock while a neighbour's free or placement updates its prev-alloc
+ * bit under the lock. Relaxed atomics keep both sides race free.
+ */
+#define GET_SHARED(p) __atomic_load_n((unsigned int *)(p), __ATOMIC_RELAXED)
+#define PUT_SHARED(p, val) __atomic_store_n((unsigned int *)(p), (val), __ATOMIC_RELAXED)
+#define GET_SIZE_SHARED(p) (GET_SHARED(p) & ~0x7)
+
+/* ADDON_12: set in the header and footer of a free block whose interior
+ * pages have been released. Any rewrite of the tags clears it again.
+ */
+#define GET_RELEASED(p) (GET(p) & 0x4)
+#define SET_RELEASED(p) (PUT(p, GET(p) | 0x4))
+
+/* ADDON_2: explicit free list links, stored in the payload of a free block.
+ * The successor pointer sits at bp, the predecessor right after it, so a
+ * free block must hold a header, two pointers and a footer.
+ */
+#define PTRSIZE (sizeof(void *))
+
+/* ADDON_14: with USE_COMPRESSED_LINKS, a link is the word-sized offset of
+ * the block from the heap base instead (0 for NULL; offset 0 is the 
+ * padding word, never a block). On by default in 64-bit builds, where it 
+ * halves the links; build with -DUSE_COMPRESSED_LINKS=0 for pointers.
+ */
+#ifndef USE_COMPRESSED_LINKS
+#if defined(__LP64__) || defined(_LP64)
+#define USE_COMPRESSED_LINKS 1
+#else
+#define USE_COMPRESSED_LINKS 0
+#endif
+#endif
+
+#if USE_COMPRESSED_LINKS
+#define LINKSIZE WSIZE
+#define LINK_MAXHEAP ((size_t)1 << 32)  /* offsets must fit a word */
+#else
+#define LINKSIZE PTRSIZE
+#endif
+
+/* read and write the link at p. base is the heap_base of the instance 
+ * the block belongs to; pointer links ignore it */
+static inline char *get_link(char *base, void *p)
+{
+#if USE_COMPRESSED_LINKS
+	unsigned int off = GET(p);
+
+	return off ? base + off : (char *)NULL;
+#else
+	(void)base;
+	return *(char **)p;
+#endif
+}
+
+static inline void put_link(char *base, void *p, void *bp)
+{
+#if USE_COMPRESSED_LINKS
+	PUT(p, bp ? (unsigned int)((char *)bp - base) : 0);
+#else
+	(void)base;
+	*(char **)p = (char *)bp;
+#endif
+}
+
+// #define MIN_BLKSIZE (((2*WSIZE + 2*PTRSIZE + (DSIZE-1)) / DSIZE) * DSIZE)
+/* ADDON_13: block sizes are multiples of ALIGNMENT (config.h), which is 
+ * 16 on 64-bit builds; the tags stay one word, so this is 32 there 
+ * ADDON_14: or 16 again with compressed links */
+#define MIN_BLKSIZE (((2*WSIZE + 2*LINKSIZE + (ALIGNMENT-1)) / ALIGNMENT) * ALIGNMENT)
+
+#define NEXT_FREEP(base, bp) get_link(base, bp)
+#define PREV_FREEP(base, bp) get_link(base, (char *)(bp) + LINKSIZE)
+#define SET_NEXT_FREEP(base, bp, p) put_link(base, bp, p)
+#define SET_PREV_FREEP(base, bp, p) put_link(base, (char *)(bp) + LINKSIZE, p)
+
+/* ADDON_4: block size for a payload of size bytes: header plus payload,
+ * rounded up to DSIZE, and large enough to be freed again 
+ * ADDON_7: rounded with a mask rather than a divide and multiply */
+// #define ADJUST_SIZE(size) MAX(MIN_BLKSIZE, ((size) + WSIZE + (DSIZE - 1)) & ~(size_t)(DSIZE - 1))
+/* ADDON_13: rounded up to ALIGNMENT */
+#define ADJUST_SIZE(size) MAX(MIN_BLKSIZE, ((size) + WSIZE + (ALIGNMENT - 1)) & ~(size_t)(ALIGNMENT - 1))
+
+/* ADDON_3: tree node fields of a large free block, placed after the list
+ * links. NEXT/PREV chain the blocks of equal size behind the tree node;
+ * the node itself is the one whose predecessor is NULL.
+ */
+#define LEFT_CHILD(base, bp) get_link(base, (char *)(bp) + 2*LINKSIZE)
+#define RIGHT_CHILD(base, bp) get_link(base, (char *)(bp) + 3*LINKSIZE)
+#define SET_LEFT_CHILD(base, bp, p) put_link(base, (char *)(bp) + 2*LINKSIZE, p)
+#define SET_RIGHT_CHILD(base, bp, p) put_link(base, (char *)(bp) + 3*LINKSIZE, p)
+#define TREE_HEIGHTP(bp) ((char *)(bp) + 4*LINKSIZE)
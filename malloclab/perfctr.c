@@ -0,0 +1,136 @@
+/*
+ * perfctr.c - AN: Count hardware events during one run of a function f
+ *
+ * Each event is opened on its own with perf_event_open (Linux), so a 
+ * PMU that lacks one event, or a kernel that is multiplexing counters,
+ * still gives the others. The counts are of user mode only, which is
+ * allowed at perf_event_paranoid 2. Where the system call or an event
+ * is not available (no PMU in a VM, a seccomp filter, paranoid 3, not
+ * Linux), the event is reported as not counted and f still runs.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "perfctr.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static char *names[PERFCTR_EVENTS] = {
+    "instructions", "cycles", "l1d_misses", "llc_misses", "dtlb_misses", 
+    "branch_misses"
+};
+
+/* errno of the first event that could not be opened, or 0 */
+static int first_errno = 0;
+
+#ifdef __linux__
+
+/* A read miss in a cache of the generic cache events */
+#define READ_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+			  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static struct {
+    unsigned type;
+    unsigned long long config;
+} events[PERFCTR_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HW_CACHE, READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+/* open event e, disabled, for this thread on any CPU */
+static int open_event(int e)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[e].type;
+    attr.config = events[e].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | 
+	PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * perfctr_measure - count the events during one run of f(argp)
+ */
+int perfctr_measure(perfctr_test_funct f, void *argp, double *counts)
+{
+    int fd[PERFCTR_EVENTS];
+    unsigned long long v[3];  /* value, time enabled, time running */
+    int e, n = 0;
+
+    for (e = 0; e < PERFCTR_EVENTS; e++) {
+	if (((fd[e] = open_event(e)) < 0) && (first_errno == 0))
+	    first_errno = errno;
+    }
+
+    for (e = 0; e < PERFCTR_EVENTS; e++)
+	if (fd[e] >= 0) {
+	    ioctl(fd[e], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fd[e], PERF_EVENT_IOC_ENABLE, 0);
+	}
+    f(argp);
+    for (e = 0; e < PERFCTR_EVENTS; e++)
+	if (fd[e] >= 0)
+	    ioctl(fd[e], PERF_EVENT_IOC_DISABLE, 0);
+
+    for (e = 0; e < PERFCTR_EVENTS; e++) {
+	counts[e] = -1;
+	if (fd[e] < 0)
+	    continue;
+	/* an event that never got a counter was not counted at all */
+	if ((read(fd[e], v, sizeof(v)) == sizeof(v)) && (v[2] > 0)) {
+	    counts[e] = (double)v[0] * ((double)v[1] / (double)v[2]);
+	    n++;
+	}
+	close(fd[e]);
+    }
+    return n;
+}
+
+#else
+
+/*
+ * perfctr_measure - no counters on this platform; just run f(argp)
+ */
+int perfctr_measure(perfctr_test_funct f, void *argp, double *counts)
+{
+    int e;
+
+    f(argp);
+    for (e = 0; e < PERFCTR_EVENTS; e++)
+	counts[e] = -1;
+    first_errno = ENOSYS;
+    return 0;
+}
+
+#endif
+
+/*
+ * perfctr_name - the name of event e
+ */
+char *perfctr_name(int e)
+{
+    return names[e];
+}
+
+/*
+ * perfctr_errno - why an event could not be counted, as an errno, or 0
+ */
+int perfctr_errno(void)
+{
+    return first_errno;
+}
@@ -0,0 +1,31 @@
+/*
+ * perfctr.h - AN: prototypes for the routines in perfctr.c that count
+ *     hardware events during one run of a test function f
+ */
+
+/* The test function takes a generic pointer as input */
+typedef void (*perfctr_test_funct)(void *);
+
+/* The events counted, in this order */
+#define PERFCTR_INSTRUCTIONS 0  /* instructions retired */
+#define PERFCTR_CYCLES       1  /* CPU cycles */
+#define PERFCTR_L1D_MISSES   2  /* L1 data cache read misses */
+#define PERFCTR_LLC_MISSES   3  /* last level cache read misses */
+#define PERFCTR_DTLB_MISSES  4  /* data TLB read misses */
+#define PERFCTR_BRANCH_MISSES 5 /* mispredicted branches */
+#define PERFCTR_EVENTS       6
+
+/* 
+ * Count the events in user mode during one run of f(argp). counts[e] 
+ * is the count of event e, scaled up if the kernel had to multiplex 
+ * it, or -1 if it could not be counted. Return the number of events 
+ * counted.
+ */
+int perfctr_measure(perfctr_test_funct f, void *argp, double *counts);
+
+/* The name of event e */
+char *perfctr_name(int e);
+
+/* Why the first event that could not be counted was not (an errno, 
+ * for strerror), or 0 */
+int perfctr_errno(void);
@@ -0,0 +1,485 @@
+/*
+ * stats.c - AN: Print the stats of mdriver.c, and write them to a JSON 
+ *     or CSV file
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "fsecs.h"
+#include "perfctr.h"
+#include "mdriver.h"
+#include "stats.h"
+
+/* the size classes of the latency histograms, one per path mm.c takes */
+size_t lat_class_max[LAT_CLASSES] = {0, 0, 0, (size_t)-1};
+char *lat_class_names[LAT_CLASSES + 1] = {
+    "slab", "lists", "tree", "large", "all"
+};
+char *lat_type_names[LAT_TYPES] = {"malloc", "free", "realloc"};
+
+/* AN: mm_path_limits fills all the classes but the last */
+typedef char lat_classes_match[(LAT_CLASSES == MM_PATHS) ? 1 : -1];
+
+static void writestats(FILE *fp, int csv, char *name, char **tracefiles, 
+		       int n, stats_t *stats);
+static void writestring(FILE *fp, int csv, char *s);
+
+/*
+ * init_lat_classes - AN: the largest request of each size class, from 
+ *     mm.c, which knows where its paths end for this build
+ */
+void init_lat_classes(void)
+{
+    mm_path_limits(lat_class_max);
+}
+
+/*
+ * thread_steps - AN: the thread counts a trace of threads threads is 
+ *     replayed on: the powers of two below threads, then threads
+ */
+int thread_steps(int threads, int *steps)
+{
+    int n = 0, t;
+
+    for (t = 1; t < threads; t *= 2)
+	steps[n++] = t;
+    steps[n++] = threads;
+    return n;
+}
+
+/*
+ * printresults - prints a performance summary for some malloc package
+ */
+void printresults(int n, stats_t *stats)
+{
+    int i;
+    double secs = 0;
+    double ops = 0;
+    double util = 0;
+    double rss = 0;
+
+    /* Print the individual results for each trace */
+    printf("%5s%7s %5s%5s%6s%7s%7s%8s%10s%6s\n", 
+	   "trace", " valid", "util", "rss", "large", "peakK", "finalK", 
+	   "ops", "secs", "Kops");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%10s%5.0f%%%4.0f%%%5.0f%%%7.0f%7.0f%8.0f%10.6f%6.0f\n", 
+		   i,
+		   "yes",
+		   stats[i].util*100.0,
+		   stats[i].rss*100.0,
+		   stats[i].large*100.0,
+		   stats[i].peak/1024.0,
+		   stats[i].final/1024.0,
+		   stats[i].ops,
+		   stats[i].secs,
+		   (stats[i].ops/1e3)/stats[i].secs);
+	    secs += stats[i].secs;
+	    ops += stats[i].ops;
+	    util += stats[i].util;
+	    rss += stats[i].rss;
+	}
+	else {
+	    printf("%2d%10s%6s%5s%6s%7s%7s%8s%10s%6s\n", 
+		   i,
+		   "no",
+		   "-",
+		   "-",
+		   "-",
+		   "-",
+		   "-",
+		   "-",
+		   "-",
+		   "-");
+	}
+    }
+
+    /* Print the aggregate results for the set of traces */
+    if (errors == 0) {
+	printf("%12s%5.0f%%%4.0f%%%20s%8.0f%10.6f%6.0f\n", 
+	       "Total       ",
+	       (util/n)*100.0,
+	       (rss/n)*100.0,
+	       "",
+	       ops, 
+	       secs,
+	       (ops/1e3)/secs);
+    }
+    else {
+	printf("%12s%6s%5s%20s%8s%10s%6s\n", 
+	       "Total       ",
+	       "-", 
+	       "-", 
+	       "", 
+	       "-", 
+	       "-", 
+	       "-");
+    }
+
+}
+
+/*
+ * printhuge - AN: compares the throughput of the mm package on the base
+ *     page heap and on the huge page heap
+ */
+void printhuge(int n, stats_t *stats, int pages)
+{
+    int i;
+    double secs = 0;
+    double hsecs = 0;
+    double ops = 0;
+
+    printf("%5s%10s%10s%8s   (heap on %s)\n", 
+	   "trace", "Kops", "hugeKops", "diff", 
+	   (pages == MEM_PAGES_HUGETLB) ? "hugetlb pages" :
+	   (pages == MEM_PAGES_THP) ? "transparent huge pages" : "base pages");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%13.0f%10.0f%7.1f%%\n", 
+		   i,
+		   (stats[i].ops/1e3)/stats[i].secs,
+		   (stats[i].ops/1e3)/stats[i].hsecs,
+		   (stats[i].secs/stats[i].hsecs - 1.0)*100.0);
+	    secs += stats[i].secs;
+	    hsecs += stats[i].hsecs;
+	    ops += stats[i].ops;
+	}
+	else
+	    printf("%2d%13s%10s%8s\n", i, "-", "-", "-");
+    }
+    if (secs > 0)
+	printf("%5s%10.0f%10.0f%7.1f%%\n", 
+	       "Total",
+	       (ops/1e3)/secs,
+	       (ops/1e3)/hsecs,
+	       (secs/hsecs - 1.0)*100.0);
+}
+
+/*
+ * printthreads - AN: prints the throughput of each thread-tagged trace
+ *     on 1 to all of its threads, and the speedup over one thread
+ */
+void printthreads(int n, stats_t *stats)
+{
+    int i, s, nsteps;
+    int steps[THREAD_STEPS];
+
+    printf("%5s%8s%10s%9s\n", "trace", "threads", "Kops", "speedup");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || (stats[i].threads == 0))
+	    continue;
+	nsteps = thread_steps(stats[i].threads, steps);
+	for (s = 0; s < nsteps; s++)
+	    printf("%2d%11d%10.0f%8.2fx\n", 
+		   i,
+		   steps[s],
+		   (stats[i].ops/1e3)/stats[i].tsecs[s],
+		   stats[i].tsecs[0]/stats[i].tsecs[s]);
+    }
+}
+
+/*
+ * printtiming - AN: prints the spread of the timed runs of each trace:
+ *     fastest, median, standard deviation, and the 95% confidence 
+ *     interval of the median, also as +/- a share of it
+ */
+void printtiming(int n, stats_t *stats)
+{
+    int i;
+    fsecs_dist_t *d;
+
+    printf("%5s%5s%11s%11s%11s%24s%8s\n", 
+	   "trace", "runs", "min", "median", "stddev", "95% CI of median", "+/-");
+    for (i=0; i < n; i++) {
+	d = &stats[i].dist;
+	if (stats[i].valid && (d->n > 0))
+	    printf("%2d%8d%11.6f%11.6f%11.6f   [%9.6f,%9.6f]%7.1f%%\n", 
+		   i,
+		   d->n,
+		   d->min,
+		   d->median,
+		   d->stddev,
+		   d->ci_lo,
+		   d->ci_hi,
+		   (d->ci_hi - d->ci_lo) / 2 / d->median * 100.0);
+	else
+	    printf("%2d%8s%11s%11s%11s%24s%8s\n", i, "-", "-", "-", "-", "-", "-");
+    }
+}
+
+/*
+ * printevents - AN: prints the hardware events of a run of each trace,
+ *     per op, next to its utilization and throughput. Events that could
+ *     not be counted show as "-". The reason comes with the stats, as 
+ *     the events are counted in the workers under -j.
+ */
+void printevents(int n, stats_t *stats)
+{
+    int i, e, why = 0;
+    double *ev;
+
+    printf("%5s%6s%9s%7s%8s%8s%6s%8s%8s%8s%8s\n", 
+	   "trace", "util", "ops", "Kops", "instrs", "cycles", "IPC", 
+	   "L1d", "LLC", "dTLB", "branch");
+    for (i=0; i < n; i++) {
+	ev = stats[i].events;
+	if (!stats[i].valid) {
+	    printf("%2d%9s\n", i, "-");
+	    continue;
+	}
+	if (why == 0)
+	    why = stats[i].events_errno;
+	printf("%2d%8.0f%%%8.0f%7.0f", 
+	       i,
+	       stats[i].util*100.0,
+	       stats[i].ops,
+	       (stats[i].ops/1e3)/stats[i].secs);
+	for (e = 0; e < PERFCTR_EVENTS; e++) {
+	    if (ev[e] < 0)
+		printf("%8s%s", "-", (e == PERFCTR_CYCLES) ? "     -" : "");
+	    else if (e <= PERFCTR_CYCLES)
+		printf("%8.1f", ev[e]/stats[i].ops);
+	    else
+		printf("%8.3f", ev[e]/stats[i].ops);
+	    /* instructions per cycle, after the cycles */
+	    if ((e == PERFCTR_CYCLES) && (ev[e] >= 0))
+		printf("%6.2f", (ev[PERFCTR_INSTRUCTIONS] >= 0) ? 
+		       ev[PERFCTR_INSTRUCTIONS]/ev[PERFCTR_CYCLES] : 0.0);
+	}
+	printf("\n");
+    }
+    if (why != 0)
+	printf("Some events were not counted: perf_event_open: %s\n", 
+	       strerror(why));
+}
+
+/*
+ * printlatency - AN: prints the latency percentiles of each request type
+ *     of each trace, for all sizes and then per size class, and its 
+ *     slowest requests
+ */
+void printlatency(int n, char **tracefiles, stats_t *stats)
+{
+    int i, t, c;
+    latency_t *l;
+    slowop_t *w;
+
+    for (i=0; i < n; i++) {
+	printf("%2d %s%s\n", i, tracefiles[i], stats[i].valid ? "" : " -");
+	if (!stats[i].valid)
+	    continue;
+	printf("%11s%7s%9s%9s%9s%9s%10s\n", 
+	       "request", "path", "count", "p50", "p99", "p99.9", "max");
+	for (t = 0; t < LAT_TYPES; t++) {
+	    for (c = -1; c < LAT_CLASSES; c++) {
+		l = &stats[i].lat[t][(c < 0) ? LAT_CLASSES : c];
+		if ((l->count == 0) || 
+		    ((c >= 0) && 
+		     (l->count == stats[i].lat[t][LAT_CLASSES].count)))
+		    continue;  /* and classes that hold every request */
+		printf("%11s%7s%9ld%9.0f%9.0f%9.0f%10.0f\n", 
+		       (c < 0) ? lat_type_names[t] : "", 
+		       lat_class_names[(c < 0) ? LAT_CLASSES : c], 
+		       l->count, l->p50, l->p99, l->p999, l->max);
+	    }
+	}
+	printf("%11s", "slowest");
+	for (c = 0; (c < LAT_WORST) && (stats[i].worst[c].ns > 0); c++) {
+	    w = &stats[i].worst[c];
+	    printf("%s#%ld %s %zu B %.0f ns", c ? ", " : " ", w->opnum, 
+		   lat_type_names[w->type], w->size, w->ns);
+	}
+	printf("\n");
+    }
+}
+
+/*
+ * writeresults - AN: write the results to file, as CSV if its name ends
+ *     in .csv and as JSON otherwise. Every timed run is in it.
+ */
+void writeresults(char *file, char **tracefiles, int n, 
+		  stats_t *libc_stats, stats_t *mm_stats, 
+		  int warmup, int samples, double perfindex)
+{
+    FILE *fp;
+    int i;
+    size_t len = strlen(file);
+    int csv = (len > 4) && !strcmp(file + len - 4, ".csv");
+    char *timer = fsecs_timer_name();
+
+    if ((fp = fopen(file, "w")) == NULL) {
+	sprintf(msg, "Could not open %s in writeresults", file);
+	unix_error(msg);
+    }
+
+    if (csv) {
+	fprintf(fp, "malloc,trace,valid,util,rss,ops,secs,kops,runs,min,"
+		"median,mean,stddev,ci_lo,ci_hi,samples");
+	for (i = 0; i < PERFCTR_EVENTS; i++)
+	    fprintf(fp, ",%s", perfctr_name(i));
+	fprintf(fp, "\n");
+	if (libc_stats != NULL)
+	    writestats(fp, csv, "libc", tracefiles, n, libc_stats);
+	writestats(fp, csv, "mm", tracefiles, n, mm_stats);
+    }
+    else {
+	fprintf(fp, "{\n  \"timer\": ");
+	writestring(fp, csv, timer);
+	fprintf(fp, ",\n  \"warmup\": %d,\n"
+		"  \"samples\": %d,\n  \"perfindex\": %.1f,\n", 
+		warmup, samples, perfindex);
+	if (libc_stats != NULL) {
+	    fprintf(fp, "  \"libc\": [\n");
+	    writestats(fp, csv, "libc", tracefiles, n, libc_stats);
+	    fprintf(fp, "  ],\n");
+	}
+	fprintf(fp, "  \"mm\": [\n");
+	writestats(fp, csv, "mm", tracefiles, n, mm_stats);
+	fprintf(fp, "  ]\n}\n");
+    }
+
+    if (fclose(fp) != 0) {
+	sprintf(msg, "Could not write %s in writeresults", file);
+	unix_error(msg);
+    }
+}
+
+/*
+ * writestats - AN: one record per trace for writeresults; the timing of
+ *     a trace that is not valid is left out
+ */
+static void writestats(FILE *fp, int csv, char *name, char **tracefiles, 
+		       int n, stats_t *stats)
+{
+    int i, j, k;
+    fsecs_dist_t *d;
+    latency_t *l;
+
+    for (i=0; i < n; i++) {
+	d = &stats[i].dist;
+	if (csv) {
+	    writestring(fp, csv, name);
+	    fprintf(fp, ",");
+	    writestring(fp, csv, tracefiles[i]);
+	    fprintf(fp, ",%d,%.6f,%.6f,%.0f", 
+		    stats[i].valid, stats[i].util, stats[i].rss, stats[i].ops);
+	    if (stats[i].valid) {
+		fprintf(fp, ",%.9f,%.3f,%d,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,", 
+			stats[i].secs, (stats[i].ops/1e3)/stats[i].secs, d->n, 
+			d->min, d->median, d->mean, d->stddev, 
+			d->ci_lo, d->ci_hi);
+		for (j = 0; j < d->n; j++)
+		    fprintf(fp, "%s%.9f", j ? " " : "", d->samples[j]);
+	    }
+	    else
+		fprintf(fp, ",,,,,,,,,,");
+	    /* AN: the events, empty unless counted */
+	    for (j = 0; j < PERFCTR_EVENTS; j++)
+		if (stats[i].valid && (stats[i].nevents > 0) && 
+		    (stats[i].events[j] >= 0))
+		    fprintf(fp, ",%.0f", stats[i].events[j]);
+		else
+		    fprintf(fp, ",");
+	    fprintf(fp, "\n");
+	    continue;
+	}
+
+	fprintf(fp, "    {\"trace\": ");
+	writestring(fp, csv, tracefiles[i]);
+	fprintf(fp, ", \"valid\": %d, \"util\": %.6f, "
+		"\"rss\": %.6f, \"ops\": %.0f", 
+		stats[i].valid, stats[i].util, stats[i].rss, stats[i].ops);
+	if (stats[i].valid) {
+	    fprintf(fp, ",\n     \"secs\": %.9f, \"kops\": %.3f, "
+		    "\"runs\": %d, \"min\": %.9f, \"median\": %.9f, "
+		    "\"mean\": %.9f, \"stddev\": %.9f, "
+		    "\"ci_lo\": %.9f, \"ci_hi\": %.9f,\n     \"samples\": [", 
+		    stats[i].secs, (stats[i].ops/1e3)/stats[i].secs, d->n, 
+		    d->min, d->median, d->mean, d->stddev, d->ci_lo, d->ci_hi);
+	    for (j = 0; j < d->n; j++)
+		fprintf(fp, "%s%.9f", j ? ", " : "", d->samples[j]);
+	    fprintf(fp, "]");
+	    /* AN: and the events that were counted */
+	    if (stats[i].nevents > 0) {
+		fprintf(fp, ",\n     \"events\": {");
+		for (j = 0, k = 0; j < PERFCTR_EVENTS; j++)
+		    if (stats[i].events[j] >= 0)
+			fprintf(fp, "%s\"%s\": %.0f", k++ ? ", " : "", 
+				perfctr_name(j), stats[i].events[j]);
+		fprintf(fp, "}");
+	    }
+	    /* AN: and the request latencies, in ns (-L) */
+	    if (time_requests) {
+		fprintf(fp, ",\n     \"latency\": {");
+		for (j = 0; j < LAT_TYPES; j++) {
+		    l = &stats[i].lat[j][LAT_CLASSES];
+		    fprintf(fp, "%s\"%s\": {\"count\": %ld, \"p50\": %.0f, "
+			    "\"p99\": %.0f, \"p999\": %.0f, \"max\": %.0f}", 
+			    j ? ",\n                 " : "", lat_type_names[j], 
+			    l->count, l->p50, l->p99, l->p999, l->max);
+		}
+		fprintf(fp, "},\n     \"slowest\": [");
+		for (j = 0; (j < LAT_WORST) && (stats[i].worst[j].ns > 0); j++)
+		    fprintf(fp, "%s{\"op\": %ld, \"request\": \"%s\", "
+			    "\"size\": %lu, \"ns\": %.0f}", j ? ", " : "", 
+			    stats[i].worst[j].opnum, 
+			    lat_type_names[stats[i].worst[j].type], 
+			    (unsigned long)stats[i].worst[j].size, 
+			    stats[i].worst[j].ns);
+		fprintf(fp, "]");
+	    }
+	}
+	fprintf(fp, "}%s\n", (i < n-1) ? "," : "");
+    }
+}
+
+/*
+ * writestring - a string value for writestats: a quoted CSV field, 
+ *     with its quotes doubled, or a JSON string, with quotes, 
+ *     backslashes and control characters escaped
+ */
+static void writestring(FILE *fp, int csv, char *s)
+{
+    fputc('"', fp);
+    for (; *s != '\0'; s++) {
+	if (csv && (*s == '"'))
+	    fputs("\"\"", fp);
+	else if (csv)
+	    fputc(*s, fp);
+	else if ((*s == '"') || (*s == '\\'))
+	    fprintf(fp, "\\%c", *s);
+	else if ((unsigned char)*s < 0x20)
+	    fprintf(fp, "\\u%04x", (unsigned char)*s);
+	else
+	    fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+/*
+ * printsbrk - AN: prints the heap growth of the mm package per trace
+ */
+void printsbrk(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%5s%7s%8s%9s%8s%7s%10s\n", 
+	   "trace", "grows", "grownK", "maxstepK", "shrinks", "peakK", 
+	   "releasedK");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid)
+	    printf("%2d%10d%8.0f%9.0f%8d%7.0f%10.0f\n", 
+		   i,
+		   stats[i].grows,
+		   stats[i].grown/1024.0,
+		   stats[i].maxstep/1024.0,
+		   stats[i].shrinks,
+		   stats[i].peak/1024.0,
+		   stats[i].released/1024.0);
+	else
+	    printf("%2d%10s%8s%9s%8s%7s%10s\n", i, "-", "-", "-", "-", "-", "-");
+    }
+}
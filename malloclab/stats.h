@@ -0,0 +1,81 @@
+/*
+ * stats.h - AN: the stats mdriver.c gathers on each trace, and the 
+ *     routines in stats.c that print and write them. Needs fsecs.h and 
+ *     perfctr.h first.
+ */
+
+#define THREAD_STEPS   8 /* replays with 1, 2, 4, ... threads, and all */
+#define LAT_TYPES      3 /* malloc, free, realloc */
+#define LAT_CLASSES    4 /* mm.c's paths (MM_PATHS), and all after them */
+#define LAT_WORST      5 /* slowest requests kept per trace */
+
+/* AN: latency percentiles of one request type and size class, in ns */
+typedef struct {
+    long count;
+    double p50, p99, p999, max;
+} latency_t;
+
+/* AN: one of the slowest requests of a trace */
+typedef struct {
+    long opnum;          /* the request */
+    int type;            /* ALLOC, FREE or REALLOC */
+    size_t size;         /* bytes asked for, or of the block freed */
+    double ns;
+} slowop_t;
+
+/* Summarizes the important stats for some malloc function on some trace */
+typedef struct {
+    /* defined for both libc malloc and student malloc package (mm.c) */
+    double ops;      /* number of ops (malloc/free/realloc) in the trace */
+    int valid;       /* was the trace processed correctly by the allocator? */
+    double secs;     /* number of secs needed to run the trace */
+
+    /* defined only for the student malloc package */
+    double util;     /* space utilization for this trace (always 0 for libc) */
+    double rss;      /* AN: utilization against the peak resident set */
+    double large;    /* AN: share of the peak heap in large object regions */
+    double peak;     /* AN: peak heap (incl. large regions) in bytes */
+    double final;    /* AN: heap left when the trace is done, in bytes */
+    int grows;       /* AN: sbrk events that grew the heap ... */
+    int shrinks;     /* AN: ... and that gave memory back */
+    double grown;    /* AN: bytes added by the growing events */
+    double maxstep;  /* AN: largest single growth, in bytes */
+    double released; /* AN: bytes of free pages released by mm.c */
+    double hsecs;    /* AN: secs needed with a huge page heap (-H) */
+    int threads;     /* AN: threads of a thread-tagged trace, else 0 */
+    double tsecs[THREAD_STEPS]; /* AN: secs of its replays on threads */
+    fsecs_dist_t dist; /* AN: the timed runs behind secs */
+    int nevents;     /* AN: hardware events counted on one run (-e) ... */
+    double events[PERFCTR_EVENTS]; /* AN: ... and their counts, or -1 */
+    int events_errno; /* AN: why one was not counted, or 0 */
+    latency_t lat[LAT_TYPES][LAT_CLASSES + 1]; /* AN: per request (-L) */
+    slowop_t worst[LAT_WORST]; /* AN: and the slowest, slowest first */
+
+    /* Note: secs and util are only defined if valid is true */
+} stats_t;
+
+/* The size classes of the latency histograms, set by init_lat_classes,
+ * and the names of the classes and request types */
+extern size_t lat_class_max[LAT_CLASSES];
+extern char *lat_class_names[LAT_CLASSES + 1];
+extern char *lat_type_names[LAT_TYPES];
+
+/* Take the size classes from the paths of mm.c */
+void init_lat_classes(void);
+
+/* The thread counts a trace of threads threads is replayed on */
+int thread_steps(int threads, int *steps);
+
+/* Print the stats of n traces, one table each */
+void printresults(int n, stats_t *stats);
+void printsbrk(int n, stats_t *stats);
+void printhuge(int n, stats_t *stats, int pages);
+void printthreads(int n, stats_t *stats);
+void printtiming(int n, stats_t *stats);
+void printevents(int n, stats_t *stats);
+void printlatency(int n, char **tracefiles, stats_t *stats);
+
+/* Write them to file, as JSON or CSV */
+void writeresults(char *file, char **tracefiles, int n, 
+		  stats_t *libc_stats, stats_t *mm_stats, 
+		  int warmup, int samples, double perfindex);
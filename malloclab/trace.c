@@ -0,0 +1,570 @@
+/*
+ * trace.c - AN: Read the trace files of mdriver.c
+ *
+ * A text trace (.rep) is mapped and parsed in place, and its requests 
+ * are written to a binary cache (.repb) next to it, which later runs 
+ * load instead. A long trace, or any with -S, is streamed: only 
+ * TRACE_CHUNK requests are in memory at a time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mdriver.h"
+#include "trace.h"
+
+#define TRACE_CHUNK 65536 /* requests in memory for a streamed trace */
+#define STREAM_MINOPS (1L << 24) /* longer traces are always streamed */
+
+/* 
+ * AN: header of a binary trace (.repb). The ops follow as an array of 
+ * traceop_t, exactly as in memory, so the file only loads into the 
+ * build that wrote it (REPB_VERSION, opsize); any other gets a new one.
+ * A cache is only used for the text trace with the exact size and 
+ * modification time it was made from.
+ */
+#define REPB_MAGIC "REPB"
+#define REPB_VERSION 3
+
+typedef struct {
+    char magic[4];       /* REPB_MAGIC */
+    int version;         /* REPB_VERSION */
+    int opsize;          /* sizeof(traceop_t) of the writer */
+    int sugg_heapsize;   /* the four numbers of the text header */
+    int num_ids;
+    int weight;
+    long text_size;      /* st_size of the text trace, or 0 */
+    long text_sec;       /* and its st_mtim */
+    long text_nsec;
+    long num_ops;        /* AN: last, where it keeps the ops aligned */
+} repb_header_t;
+
+int use_cache = 1;
+int stream_traces = 0;
+
+static int open_repb(trace_t *trace, char *file, char *path);
+static void repb_abort(trace_t *trace);
+static void repb_begin(trace_t *trace);
+static void repb_add(trace_t *trace, traceop_t *ops, long n);
+static int repb_end(trace_t *trace);
+
+/**********************************************
+ * The following routines manipulate tracefiles
+ *********************************************/
+
+/*
+ * AN: helpers of the .rep parser. The trace is mapped and scanned in 
+ * place; p never moves past end.
+ */
+static char *skip_space(char *p, char *end)
+{
+    while ((p < end) && isspace((unsigned char)*p))
+	p++;
+    return p;
+}
+
+static char *parse_num(char *p, char *end, size_t *val, char *path)
+{
+    size_t v = 0;
+
+    p = skip_space(p, end);
+    if ((p == end) || !isdigit((unsigned char)*p)) {
+	sprintf(msg, "Expected a number in tracefile %s", path);
+	app_error(msg);
+    }
+    while ((p < end) && isdigit((unsigned char)*p))
+	v = 10*v + (*p++ - '0');
+    *val = v;
+    return p;
+}
+
+/*
+ * open_rep - AN: map the text trace at trace->path and read its header.
+ *     The requests are parsed later, by parse_ops.
+ */
+static void open_rep(trace_t *trace)
+{
+    int fd;
+    struct stat st;
+    char *map, *p, *end;
+    size_t val;
+
+    if (((fd = open(trace->path, O_RDONLY)) < 0) || (fstat(fd, &st) < 0)) {
+	sprintf(msg, "Could not open %s in read_trace", trace->path);
+	unix_error(msg);
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+	sprintf(msg, "Could not map %s in read_trace", trace->path);
+	unix_error(msg);
+    }
+    close(fd);
+    trace->text = st;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    p = map;
+    end = map + st.st_size;
+
+    /* the header */
+    p = parse_num(p, end, &val, trace->path);
+    trace->sugg_heapsize = val;                 /* not used */
+    p = parse_num(p, end, &val, trace->path);
+    trace->num_ids = val;
+    p = parse_num(p, end, &val, trace->path);
+    trace->num_ops = val;
+    p = parse_num(p, end, &val, trace->path);
+    trace->weight = val;                        /* not used */
+
+    /* AN: a fifth number is the thread count of a thread-tagged trace */
+    if (((p = skip_space(p, end)) < end) && isdigit((unsigned char)*p)) {
+	p = parse_num(p, end, &val, trace->path);
+	if ((val == 0) || (val > MAXTHREADS)) {
+	    sprintf(msg, "Tracefile %s has %zu threads, not 1 to %d", 
+		    trace->path, val, MAXTHREADS);
+	    app_error(msg);
+	}
+	trace->threads = val;
+    }
+
+    trace->map = map;
+    trace->maplen = st.st_size;
+    trace->start = trace->cursor = p;
+}
+
+/*
+ * parse_ops - AN: parse up to max requests at trace->cursor into ops. 
+ *     Returns how many; 0 once the text is used up.
+ */
+static long parse_ops(trace_t *trace, traceop_t *ops, long max)
+{
+    char *p = trace->cursor;
+    char *end = (char *)trace->map + trace->maplen;
+    char type;
+    size_t val, index, tid = 0;
+    long n;
+
+    /* one request per line: a type word, then the index and for 'a' and
+     * 'r' the size */
+    /* AN: in a thread-tagged trace, the thread comes first */
+    for (n = 0;  (n < max) && ((p = skip_space(p, end)) < end);  n++) {
+	if (trace->threads > 0) {
+	    p = skip_space(parse_num(p, end, &tid, trace->path), end);
+	    if (tid >= (size_t)trace->threads) {
+		sprintf(msg, "Thread %zu out of range in tracefile %s", 
+			tid, trace->path);
+		app_error(msg);
+	    }
+	}
+	type = *p;
+	while ((p < end) && !isspace((unsigned char)*p))
+	    p++;
+	if (trace->done + n == trace->num_ops) {
+	    sprintf(msg, "More than %ld requests in tracefile %s", 
+		    trace->num_ops, trace->path);
+	    app_error(msg);
+	}
+
+	switch(type) {
+	case 'a':
+	case 'r':
+	    p = parse_num(p, end, &index, trace->path);
+	    p = parse_num(p, end, &val, trace->path);
+	    ops[n].type = (type == 'a') ? ALLOC : REALLOC;
+	    ops[n].index = index;
+	    ops[n].size = val;
+	    trace->max_index = (index > trace->max_index) ? index : trace->max_index;
+	    break;
+	case 'f':
+	    p = parse_num(p, end, &index, trace->path);
+	    ops[n].type = FREE;
+	    ops[n].index = index;
+	    ops[n].size = 0;
+	    break;
+	default:
+	    printf("Bogus type character (%c) in tracefile %s\n", 
+		   type, trace->path);
+	    exit(1);
+	}
+	/* AN: before any block of the id is touched */
+	if (index >= (size_t)trace->num_ids) {
+	    sprintf(msg, "Id %zu out of range in tracefile %s", 
+		    index, trace->path);
+	    app_error(msg);
+	}
+	if (trace->threads > 0)
+	    trace->tids[trace->done + n] = tid;
+    }
+
+    trace->cursor = p;
+    trace->done += n;
+    return n;
+}
+
+/*
+ * open_repb - AN: open the binary trace at file and read its header into
+ *     trace. If path is given, the file must be the cache of that text 
+ *     trace as it is now. Returns the open file, or -1 if it is not usable.
+ */
+static int open_repb(trace_t *trace, char *file, char *path)
+{
+    int fd;
+    struct stat st, text;
+    repb_header_t hdr;
+
+    if ((fd = open(file, O_RDONLY)) < 0)
+	return -1;
+    if ((fstat(fd, &st) < 0) || 
+	(pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) ||
+	((path != NULL) && 
+	 ((stat(path, &text) < 0) || (hdr.text_size != (long)text.st_size) ||
+	  (hdr.text_sec != (long)text.st_mtim.tv_sec) || 
+	  (hdr.text_nsec != (long)text.st_mtim.tv_nsec)))) {
+	close(fd);
+	return -1;
+    }
+
+    /* written by this build of the driver, and complete */
+    if (memcmp(hdr.magic, REPB_MAGIC, sizeof(hdr.magic)) || 
+	(hdr.version != REPB_VERSION) || 
+	(hdr.opsize != sizeof(traceop_t)) || (hdr.num_ops < 0) ||
+	((size_t)st.st_size != 
+	 sizeof(repb_header_t) + hdr.num_ops * sizeof(traceop_t))) {
+	close(fd);
+	return -1;
+    }
+
+    trace->sugg_heapsize = hdr.sugg_heapsize;
+    trace->num_ids = hdr.num_ids;
+    trace->num_ops = hdr.num_ops;
+    trace->weight = hdr.weight;
+    trace->maplen = st.st_size;
+    return fd;
+}
+
+/*
+ * repb_begin, repb_add, repb_end - AN: write the ops of trace to its 
+ *     .repb cache, as they are parsed. Best effort: a trace directory we
+ *     cannot write to just goes without a cache. The file is private 
+ *     until repb_end renames it into place, which it reports with 1.
+ */
+static void repb_abort(trace_t *trace)
+{
+    fclose(trace->cache);
+    unlink(trace->cachetmp);
+    trace->cache = NULL;
+}
+
+static void repb_begin(trace_t *trace)
+{
+    repb_header_t hdr;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, REPB_MAGIC, sizeof(hdr.magic));
+    hdr.version = REPB_VERSION;
+    hdr.opsize = sizeof(traceop_t);
+    hdr.sugg_heapsize = trace->sugg_heapsize;
+    hdr.num_ids = trace->num_ids;
+    hdr.num_ops = trace->num_ops;
+    hdr.weight = trace->weight;
+    hdr.text_size = trace->text.st_size;
+    hdr.text_sec = trace->text.st_mtim.tv_sec;
+    hdr.text_nsec = trace->text.st_mtim.tv_nsec;
+
+    snprintf(trace->cachetmp, sizeof(trace->cachetmp), "%s.%d", 
+	     trace->cachepath, (int)getpid());
+    if ((trace->cache = fopen(trace->cachetmp, "wb")) == NULL)
+	return;
+    if (fwrite(&hdr, sizeof(hdr), 1, trace->cache) != 1)
+	repb_abort(trace);
+}
+
+static void repb_add(trace_t *trace, traceop_t *ops, long n)
+{
+    if ((trace->cache != NULL) && 
+	(fwrite(ops, sizeof(traceop_t), n, trace->cache) != (size_t)n))
+	repb_abort(trace);
+}
+
+static int repb_end(trace_t *trace)
+{
+    int ok;
+
+    if (trace->cache == NULL)
+	return 0;
+    ok = (fclose(trace->cache) == 0);
+    trace->cache = NULL;
+    if (!ok || (rename(trace->cachetmp, trace->cachepath) < 0)) {
+	unlink(trace->cachetmp);
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * check_trace - AN: once all requests are parsed, they must match the 
+ *     header
+ */
+static void check_trace(trace_t *trace)
+{
+    assert((long)trace->max_index == trace->num_ids - 1);
+    assert(trace->num_ops == trace->done);
+}
+
+/*
+ * trace_refill - AN: the TRACE_NEXT slow path. Reads the next chunk of a
+ *     streamed trace and returns its first request, or NULL at the end.
+ *     The first pass over a text trace also writes the .repb cache, 
+ *     which later passes then stream from instead.
+ */
+traceop_t *trace_refill(trace_t *trace)
+{
+    long n = 0;
+    ssize_t len, got;
+    char *buf;
+    off_t off;
+
+    if (trace->source == TRACE_MEMORY)
+	return NULL;
+    if (trace->source == TRACE_TEXT) {
+	if ((n = parse_ops(trace, trace->ops, TRACE_CHUNK)) > 0)
+	    repb_add(trace, trace->ops, n);
+	else if (!trace->checked) {
+	    check_trace(trace);
+	    trace->checked = 1;
+	    if (repb_end(trace) && 
+		((trace->fd = open(trace->cachepath, O_RDONLY)) >= 0)) {
+		munmap(trace->map, trace->maplen);
+		trace->map = NULL;
+		trace->source = TRACE_REPB;
+	    }
+	}
+    }
+    else if (trace->source == TRACE_REPB) {
+	n = trace->num_ops - trace->done;
+	n = (n < TRACE_CHUNK) ? n : TRACE_CHUNK;
+	buf = (char *)trace->ops;
+	len = n * sizeof(traceop_t);
+	off = sizeof(repb_header_t) + trace->done * sizeof(traceop_t);
+	while (len > 0) {
+	    if ((got = pread(trace->fd, buf, len, off)) <= 0) {
+		sprintf(msg, "Could not read %s", trace->cachepath);
+		unix_error(msg);
+	    }
+	    buf += got;
+	    off += got;
+	    len -= got;
+	}
+	trace->done += n;
+    }
+
+    trace->nops = n;
+    trace->pos = 0;
+    return (n > 0) ? &trace->ops[trace->pos++] : NULL;
+}
+
+/*
+ * trace_rewind - AN: start over at the first request. Each pass over a 
+ *     text trace until one completes starts a new cache; one that stopped
+ *     early leaves none behind.
+ */
+void trace_rewind(trace_t *trace)
+{
+    trace->pos = 0;
+    if (trace->source == TRACE_MEMORY)
+	return;
+
+    trace->nops = 0;
+    trace->done = 0;
+    trace->max_index = 0;
+    trace->cursor = trace->start;
+    if ((trace->source == TRACE_TEXT) && !trace->checked) {
+	if (trace->cache != NULL)
+	    repb_abort(trace);
+	if (use_cache)
+	    repb_begin(trace);
+    }
+}
+
+/*
+ * block_of, block_set, block_drop - AN: the payload and size recorded 
+ *     for request id index. A streamed trace keeps them in an id map of
+ *     leaves for IDMAP_LEAF ids each, made on first use and freed when
+ *     none of their ids is live, rather than in a dense array.
+ */
+block_t *block_of(trace_t *trace, int index)
+{
+    idleaf_t **leafp;
+
+    if (trace->blocks != NULL)
+	return &trace->blocks[index];
+
+    leafp = &trace->leaves[index >> IDMAP_BITS];
+    if ((*leafp == NULL) && ((*leafp = calloc(1, sizeof(idleaf_t))) == NULL))
+	unix_error("calloc failed in block_of");
+    return &(*leafp)->blocks[index & (IDMAP_LEAF - 1)];
+}
+
+void block_set(trace_t *trace, int index, char *p, size_t size)
+{
+    block_t *b = block_of(trace, index);
+
+    if ((trace->leaves != NULL) && (b->p == NULL))
+	trace->leaves[index >> IDMAP_BITS]->live++;
+    b->p = p;
+    b->size = size;
+}
+
+void block_drop(trace_t *trace, int index)
+{
+    idleaf_t *leaf;
+    block_t *b;
+
+    if (trace->blocks != NULL)
+	return;
+
+    leaf = trace->leaves[index >> IDMAP_BITS];
+    b = &leaf->blocks[index & (IDMAP_LEAF - 1)];
+    if (b->p == NULL)
+	return;
+    b->p = NULL;
+    if (--leaf->live == 0) {
+	free(leaf);
+	trace->leaves[index >> IDMAP_BITS] = NULL;
+    }
+}
+
+/*
+ * read_trace - read a trace file and store it in memory
+ * AN: from its .repb cache (the name with a "b" appended) when that is
+ *     up to date, else from the text, which then refreshes the cache. A
+ *     .repb file can also be named directly.
+ * AN: with -S, or if it has more than STREAM_MINOPS requests, the trace
+ *     is streamed instead: only TRACE_CHUNK requests are in memory at a
+ *     time, and the blocks are kept in an id map.
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+    trace_t *trace;
+    size_t len;
+    int fd = -1;
+
+    if (verbose > 1)
+	printf("Reading tracefile: %s\n", filename);
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) calloc(1, sizeof(trace_t))) == NULL)
+	unix_error("malloc 1 failed in read_trance");
+    trace->fd = -1;
+	
+    strcpy(trace->path, tracedir);
+    strcat(trace->path, filename);
+    len = strlen(trace->path);
+    if ((len > 5) && !strcmp(trace->path + len - 5, ".repb")) {
+	strcpy(trace->cachepath, trace->path);
+	if ((fd = open_repb(trace, trace->path, NULL)) < 0) {
+	    sprintf(msg, "%s is not a binary trace of this driver", trace->path);
+	    app_error(msg);
+	}
+    }
+    else {
+	snprintf(trace->cachepath, sizeof(trace->cachepath), "%sb", 
+		 trace->path);
+	if (!use_cache || 
+	    ((fd = open_repb(trace, trace->cachepath, trace->path)) < 0))
+	    open_rep(trace);
+    }
+
+    /* AN: a thread-tagged trace is replayed in memory, and not cached */
+    if ((trace->threads == 0) && 
+	(stream_traces || (trace->num_ops > STREAM_MINOPS))) {
+	/* AN: a chunk of requests, and an id map */
+	if ((trace->ops = 
+	     (traceop_t *)malloc(TRACE_CHUNK * sizeof(traceop_t))) == NULL)
+	    unix_error("malloc 2 failed in read_trace");
+	if ((trace->leaves = (idleaf_t **)calloc((trace->num_ids >> IDMAP_BITS) + 1,
+						  sizeof(idleaf_t *))) == NULL)
+	    unix_error("malloc 3 failed in read_trace");
+	if (fd >= 0) {
+	    trace->source = TRACE_REPB;
+	    trace->fd = fd;
+	}
+	else
+	    trace->source = TRACE_TEXT;
+	return trace;
+    }
+
+    if (fd >= 0) {
+	/* AN: the ops are used straight from the mapped file */
+	trace->map = mmap(NULL, trace->maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (trace->map == MAP_FAILED) {
+	    sprintf(msg, "Could not map %s in read_trace", trace->cachepath);
+	    unix_error(msg);
+	}
+	close(fd);
+	trace->ops = (traceop_t *)((repb_header_t *)trace->map + 1);
+    }
+    else {
+	/* We'll store each request line in the trace in this array */
+	if ((trace->ops = 
+	     (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+	    unix_error("malloc 2 failed in read_trace");
+	if ((trace->threads > 0) && 
+	    ((trace->tids = (int *)malloc(trace->num_ops * sizeof(int))) == NULL))
+	    unix_error("malloc 4 failed in read_trace");
+	parse_ops(trace, trace->ops, trace->num_ops);
+	if (skip_space(trace->cursor, (char *)trace->map + trace->maplen) < 
+	    (char *)trace->map + trace->maplen)
+	    parse_ops(trace, trace->ops, 1); /* reports the extra request */
+	check_trace(trace);
+	munmap(trace->map, trace->maplen);
+	trace->map = NULL;
+	if (use_cache && (trace->threads == 0)) {
+	    repb_begin(trace);
+	    repb_add(trace, trace->ops, trace->num_ops);
+	    repb_end(trace);
+	}
+    }
+    trace->nops = trace->num_ops;
+
+    /* We'll keep the block pointers and payload sizes of each id here */
+    if ((trace->blocks = 
+	 (block_t *)calloc(trace->num_ids, sizeof(block_t))) == NULL)
+	unix_error("malloc 3 failed in read_trace");
+    
+    return trace;
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ * AN: and whatever a mapped or streamed trace holds on to
+ */
+void free_trace(trace_t *trace)
+{
+    int i;
+
+    if (trace->cache != NULL)
+	repb_abort(trace);
+    if (trace->fd >= 0)
+	close(trace->fd);
+    if ((trace->source == TRACE_MEMORY) && (trace->map != NULL))
+	munmap(trace->map, trace->maplen);  /* AN: ops in a mapped .repb */
+    else {
+	if (trace->map != NULL)
+	    munmap(trace->map, trace->maplen);
+	free(trace->ops);
+    }
+    if (trace->leaves != NULL) {
+	for (i = 0; i <= (trace->num_ids >> IDMAP_BITS); i++)
+	    free(trace->leaves[i]);
+	free(trace->leaves);
+    }
+    free(trace->blocks);
+    free(trace->tids);
+    free(trace);              /* and the trace record itself... */
+}
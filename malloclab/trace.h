@@ -0,0 +1,84 @@
+/*
+ * trace.h - AN: the trace files of mdriver.c, read by trace.c. A trace 
+ *     is loaded whole, or streamed a chunk of requests at a time; go 
+ *     over its requests with trace_rewind and TRACE_NEXT.
+ */
+
+#define IDMAP_BITS    12 /* IDMAP_LEAF ids per leaf of the id map */
+#define IDMAP_LEAF (1 << IDMAP_BITS)
+#define MAXTHREADS    64 /* most threads in a thread-tagged trace */
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    size_t size;                      /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* AN: a block returned by malloc/realloc, and its payload size */
+typedef struct {
+    char *p;
+    size_t size;
+} block_t;
+
+/* AN: a leaf of the id map of a streamed trace */
+typedef struct {
+    int live;                     /* ids in it with a block */
+    block_t blocks[IDMAP_LEAF];
+} idleaf_t;
+
+/* AN: where the requests of a trace come from */
+#define TRACE_MEMORY 0  /* all in memory, or in a mapped .repb */
+#define TRACE_TEXT   1  /* streamed, parsed a chunk at a time */
+#define TRACE_REPB   2  /* streamed, read a chunk at a time from a .repb */
+
+/* Holds the information for one trace file*/
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    long num_ops;        /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    traceop_t *ops;      /* array of requests (AN: or the current chunk) */
+    block_t *blocks;     /* AN: block of each id, replaces blocks and 
+			    block_sizes; NULL if streamed ... */
+    idleaf_t **leaves;   /* AN: ... when the id map is used instead */
+    long nops;           /* AN: requests in ops */
+    long pos;            /* AN: next request in ops */
+    int source;          /* AN: TRACE_MEMORY, TRACE_TEXT or TRACE_REPB */
+    void *map;           /* AN: mapped trace file, or NULL */
+    size_t maplen;       /* AN: and its size */
+    char *start;         /* AN: first request in the text */
+    char *cursor;        /* AN: next one to parse */
+    size_t max_index;    /* AN: largest id parsed so far */
+    long done;           /* AN: requests parsed or read since the rewind */
+    int checked;         /* AN: a pass over the whole text has been made */
+    int threads;         /* AN: threads of a thread-tagged trace, else 0 */
+    int *tids;           /* AN: and the thread of each request */
+    int fd;              /* AN: .repb being streamed, or -1 */
+    FILE *cache;         /* AN: .repb being written, or NULL */
+    char path[MAXLINE];  /* AN: the trace file */
+    struct stat text;    /* AN: and its stat, if it is a text trace */
+    char cachepath[MAXLINE + 1];  /* AN: its .repb */
+    char cachetmp[MAXLINE + 16];  /* AN: and that while it is written */
+} trace_t;
+
+/* AN: the next request of a trace, or NULL at the end */
+#define TRACE_NEXT(t) (((t)->pos < (t)->nops) ? &(t)->ops[(t)->pos++] : \
+		       trace_refill(t))
+
+/* Options, set by mdriver.c */
+extern int use_cache;      /* load and refresh .repb trace caches (-C) */
+extern int stream_traces;  /* stream every trace (-S) */
+
+/* Read, and free, the trace filename in tracedir */
+trace_t *read_trace(char *tracedir, char *filename);
+void free_trace(trace_t *trace);
+
+/* Start over at the first request; the slow path of TRACE_NEXT */
+void trace_rewind(trace_t *trace);
+traceop_t *trace_refill(trace_t *trace);
+
+/* The payload and size recorded for request id index */
+block_t *block_of(trace_t *trace, int index);
+void block_set(trace_t *trace, int index, char *p, size_t size);
+void block_drop(trace_t *trace, int index);
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+#
+# gen-threads.py - AN: write threads-bal.rep, a balanced thread-tagged
+#     trace, to standard output:
+#
+#     ./gen-threads.py > threads-bal.rep
+#
+# T threads each make bursts of 1 to 8 requests. A request frees or
+# (one in ten) reallocates one of the blocks the thread is to free, or
+# allocates a new block. Most sizes are common small ones, one in ten is
+# anything up to 16 KB. A quarter of the new blocks are to be freed by a
+# thread other than the one that allocated them (producer/consumer).
+# Whatever is still live at the end is freed by its owner. The seed is
+# fixed, so the output is always the same file.
+#
+import random
+
+SEED = 213
+T = 8                   # threads
+OPS = 24000             # requests before the final frees
+SIZES = [16, 24, 32, 48, 64, 96, 128, 200, 256, 400, 512, 1000, 2048, 4096]
+
+
+def pick():
+    if random.random() < 0.9:
+        return random.choice(SIZES)
+    return random.randint(1, 16384)
+
+
+def main():
+    random.seed(SEED)
+    ops = []
+    nid = 0
+    pending = [[] for _ in range(T)]    # blocks each thread is to free
+
+    while len(ops) < OPS:
+        t = random.randrange(T)
+        for _ in range(random.randint(1, 8)):
+            q = pending[t]
+            if q and random.random() < 0.45 + 0.1 * (len(q) > 64):
+                i = random.randrange(len(q))
+                bid = q[i]
+                if random.random() < 0.1:
+                    ops.append("%d r %d %d" % (t, bid, pick()))
+                else:
+                    q[i] = q[-1]
+                    q.pop()
+                    ops.append("%d f %d" % (t, bid))
+            else:
+                bid = nid
+                nid += 1
+                ops.append("%d a %d %d" % (t, bid, pick()))
+                if random.random() < 0.75:
+                    owner = t
+                else:
+                    owner = (t + 1 + random.randrange(T - 1)) % T
+                pending[owner].append(bid)
+
+    for t in range(T):
+        for bid in pending[t]:
+            ops.append("%d f %d" % (t, bid))
+
+    # the header: heap size (unused), ids, requests, weight, threads
+    print("20000\n%d\n%d\n1\n%d" % (nid, len(ops), T))
+    print("\n".join(ops))
+
+
+if __name__ == "__main__":
+    main()
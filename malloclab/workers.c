@@ -0,0 +1,235 @@
+/*
+ * workers.c - AN: Evaluate the traces of mdriver.c in worker processes
+ *
+ * With -j, eval_traces forks that many workers, each pinned to a CPU 
+ * of its own and with its own copy of the memlib heap, which take trace
+ * numbers off a shared queue and send the stats of each back to be 
+ * merged for printresults(). There are never more workers than CPUs.
+ * Unless -P is given, the first CPU is kept for timing: the workers run
+ * on the others, and one that times a trace takes the timing lock and 
+ * moves to the first CPU until it is done. So timed runs go one at a 
+ * time on a CPU no one else uses, while the other workers go on checking
+ * and measuring utilization. The threads of a threaded replay are pinned
+ * to all the CPUs, the first one too, whichever worker runs it.
+ */
+#define _GNU_SOURCE /* sched_setaffinity */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/wait.h>
+#include <sched.h>
+
+#include "fsecs.h"
+#include "perfctr.h"
+#include "mdriver.h"
+#include "stats.h"
+#include "workers.h"
+
+/* AN: what a worker of a parallel run sends back for each trace */
+typedef struct {
+    int tracenum;    /* the trace */
+    int errors;      /* errors found on it */
+    stats_t stats;   /* and its stats */
+} result_t;
+
+/* AN: stats travel from a worker in one atomic write to a pipe */
+typedef char result_fits_pipe[(sizeof(result_t) <= PIPE_BUF) ? 1 : -1];
+
+int jobs = 1;
+int time_parallel = 0;
+int cpus[CPU_SETSIZE];
+int ncpus = 0;
+
+/* an unlinked file that a worker holds a write lock on while it times 
+ * a trace, so timed runs go one at a time; -1 unless the run is parallel
+ * and -P is not given. The kernel drops the lock of a worker that dies. */
+static int timing_lock = -1;
+
+/* the CPU this worker runs on when it does not time; -1 if unpinned */
+static int worker_cpu = -1;
+
+static void run_worker(int w, char **tracefiles, int work, int results, 
+		       eval_trace_t eval);
+static void timing_set(short type);
+static void pin_to(int cpu);
+
+/*
+ * init_workers - find the CPUs we may run on, after pinning the driver
+ *     to pin_cpu if it is not -1
+ */
+void init_workers(int pin_cpu)
+{
+    cpu_set_t set;
+    int i, max;
+
+    if (pin_cpu >= 0)
+	pin_to(pin_cpu);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+	for (i = 0; i < CPU_SETSIZE; i++)
+	    if (CPU_ISSET(i, &set))
+		cpus[ncpus++] = i;
+    /* one worker per CPU at most, so none shares a CPU with another, 
+     * and none on the timing CPU; one worker is a serial run */
+    max = time_parallel ? ncpus : ncpus - 1;
+    if ((ncpus > 0) && ((jobs <= 0) || (jobs > max)))
+	jobs = (max > 0) ? max : 1;
+}
+
+/*
+ * eval_traces - AN: evaluate the n traces with eval, into stats. A 
+ *     trace whose worker died before it sent the stats back counts as
+ *     an error and is not valid.
+ */
+void eval_traces(char **tracefiles, int n, stats_t *stats, 
+		 eval_trace_t eval)
+{
+    int i, w, work[2], results[2], nworkers = jobs;
+    char *done;
+    char lockfile[] = "/tmp/mdriver.XXXXXX";
+    result_t r;
+
+    if ((nworkers <= 1) || (n <= 1)) {
+	for (i = 0; i < n; i++)
+	    eval(tracefiles[i], i, &stats[i]);
+	return;
+    }
+    if (nworkers > n)
+	nworkers = n;
+
+    /* The queue of trace numbers, and the pipe the stats come back on */
+    if ((pipe(work) < 0) || (pipe(results) < 0))
+	unix_error("pipe failed in eval_traces");
+    for (i = 0; i < n; i++)
+	if (write(work[1], &i, sizeof(i)) != sizeof(i))
+	    unix_error("write failed in eval_traces");
+    close(work[1]);
+    if (!time_parallel) {
+	if ((timing_lock = mkstemp(lockfile)) < 0)
+	    unix_error("timing lock failed in eval_traces");
+	unlink(lockfile);
+    }
+
+    fflush(stdout);
+    for (w = 0; w < nworkers; w++) {
+	switch (fork()) {
+	case -1:
+	    unix_error("fork failed in eval_traces");
+	case 0:
+	    close(results[0]);
+	    run_worker(w, tracefiles, work[0], results[1], eval);
+	}
+    }
+    close(work[0]);
+    close(results[1]);
+
+    /* Merge the stats as they come in; each is one atomic write */
+    if ((done = calloc(n, 1)) == NULL)
+	unix_error("calloc failed in eval_traces");
+    while (read(results[0], &r, sizeof(r)) == sizeof(r)) {
+	stats[r.tracenum] = r.stats;
+	errors += r.errors;
+	done[r.tracenum] = 1;
+    }
+    close(results[0]);
+    while (wait(NULL) > 0)
+	;
+
+    for (i = 0; i < n; i++) {
+	if (!done[i]) {
+	    printf("ERROR [trace %d]: worker exited before it was done\n", i);
+	    errors++;
+	    memset(&stats[i], 0, sizeof(stats_t));
+	}
+    }
+    free(done);
+    if (timing_lock >= 0) {
+	close(timing_lock);
+	timing_lock = -1;
+    }
+}
+
+/*
+ * run_worker - AN: the body of worker w. Pins itself to its CPU, then 
+ *     evaluates traces off the queue until it is empty and exits.
+ */
+static void run_worker(int w, char **tracefiles, int work, int results, 
+		       eval_trace_t eval)
+{
+    result_t r;
+
+    if (ncpus > 0) {
+	if (timing_lock >= 0)
+	    worker_cpu = cpus[1 + w % (ncpus - 1)];
+	else
+	    worker_cpu = cpus[w % ncpus];
+	pin_to(worker_cpu);
+    }
+
+    while (read(work, &r.tracenum, sizeof(r.tracenum)) == 
+	   sizeof(r.tracenum)) {
+	errors = 0;
+	memset(&r.stats, 0, sizeof(stats_t));
+	eval(tracefiles[r.tracenum], r.tracenum, &r.stats);
+	r.errors = errors;
+	fflush(stdout);
+	if (write(results, &r, sizeof(r)) != sizeof(r))
+	    unix_error("write failed in run_worker");
+    }
+    exit(0);
+}
+
+/*
+ * timing_begin, timing_end - AN: take the timing lock and move to the 
+ *     timing CPU, and back, when there is a lock. Only timed runs wait
+ *     for each other.
+ */
+void timing_begin(void)
+{
+    if (timing_lock < 0)
+	return;
+    timing_set(F_WRLCK);
+    if (worker_cpu >= 0)
+	pin_to(cpus[0]);
+}
+
+void timing_end(void)
+{
+    if (timing_lock < 0)
+	return;
+    if (worker_cpu >= 0)
+	pin_to(worker_cpu);
+    timing_set(F_UNLCK);
+}
+
+/*
+ * timing_set - AN: lock or unlock the whole timing lock, waiting as long
+ *     as it takes
+ */
+static void timing_set(short type)
+{
+    struct flock fl;
+
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    while (fcntl(timing_lock, F_SETLKW, &fl) < 0)
+	if (errno != EINTR)
+	    unix_error("fcntl failed in timing_set");
+}
+
+/*
+ * pin_to - AN: run the calling process on cpu only
+ */
+static void pin_to(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+	unix_error("sched_setaffinity failed in pin_to");
+}
@@ -0,0 +1,30 @@
+/*
+ * workers.h - AN: evaluating the traces of mdriver.c one after another,
+ *     or side by side in worker processes (workers.c). Needs stats.h 
+ *     first.
+ */
+
+/* Evaluates one trace (eval_libc_trace, eval_mm_trace in mdriver.c) */
+typedef void (*eval_trace_t)(char *filename, int tracenum, stats_t *stats);
+
+/* Options, set by mdriver.c */
+extern int jobs;           /* worker processes (-j), 0 for one per CPU */
+extern int time_parallel;  /* let the workers time at the same time (-P) */
+
+/* The CPUs we may run on, that workers and replay threads are pinned 
+ * to round robin */
+extern int cpus[];
+extern int ncpus;
+
+/* Pin the driver to pin_cpu unless it is -1, and find the CPUs. Caps 
+ * jobs at the number of CPUs, less the one kept for timing unless 
+ * time_parallel. */
+void init_workers(int pin_cpu);
+
+/* Evaluate the n traces with eval, into stats */
+void eval_traces(char **tracefiles, int n, stats_t *stats, 
+		 eval_trace_t eval);
+
+/* Bracket what eval times: it runs on the timing CPU, one at a time */
+void timing_begin(void);
+void timing_end(void);